@@ -37,7 +37,7 @@
 #include "SettingsDialog.h"
 #include "IgnoreRegexDialog.h"
 #include "NavDialog.h"
-#include "Engine.h"
+#include "NppEngine.h"
 #include "NppInternalDefines.h"
 #include "resource.h"
 
@@ -1125,8 +1125,9 @@ void ComparedPair::setStatusInfo()
 					options.selections[SUB_VIEW].first + 1, options.selections[SUB_VIEW].second + 1);
 		}
 
-		infoCurrentPos = _sntprintf_s(info, _countof(info), _TRUNCATE, TEXT("%s%s"),
-				options.findUniqueMode ? TEXT("Find Unique") : TEXT("Compare"), buf);
+		infoCurrentPos = _sntprintf_s(info, _countof(info), _TRUNCATE, TEXT("%s%s%s"),
+				options.findUniqueMode ? TEXT("Find Unique") : TEXT("Compare"),
+				summary.approximate ? TEXT(" (approximate)") : TEXT(""), buf);
 
 		// Toggle shown status bar info
 		if (Settings.statusType == StatusType::COMPARE_OPTIONS)
@@ -2518,7 +2519,11 @@ void compare(bool selectionCompare = false, bool findUniqueMode = false, bool au
 		cmpPair->options.neverMarkIgnored			= Settings.NeverMarkIgnored;
 		cmpPair->options.detectMoves				= Settings.DetectMoves;
 		cmpPair->options.detectCharDiffs			= Settings.DetectCharDiffs;
+		cmpPair->options.fastCharDiffs				= Settings.FastCharDiffs;
 		cmpPair->options.bestSeqChangedLines		= Settings.BestSeqChangedLines;
+		cmpPair->options.histogramDiff				= Settings.HistogramDiff;
+		cmpPair->options.discardUnmatchedLines		= Settings.DiscardUnmatchedLines;
+		cmpPair->options.minimalLinesDiff			= Settings.MinimalLinesDiff;
 		cmpPair->options.ignoreSpaces				= Settings.IgnoreSpaces;
 		cmpPair->options.ignoreEmptyLines			= Settings.IgnoreEmptyLines;
 		cmpPair->options.ignoreCase					= Settings.IgnoreCase;
@@ -2531,6 +2536,8 @@ void compare(bool selectionCompare = false, bool findUniqueMode = false, bool au
 		cmpPair->options.changedThresholdPercent	= Settings.ChangedThresholdPercent;
 		cmpPair->options.selectionCompare			= selectionCompare;
 
+		setWorkerThreads(Settings.WorkerThreads);
+
 		cmpPair->positionFiles();
 
 		if (selectionCompare && !recompareSameSelections)
@@ -2896,8 +2903,9 @@ void CompareStats()
 
 	TCHAR info[512];
 
-	int infoCurrentPos = _sntprintf_s(info, _countof(info), _TRUNCATE, TEXT("%s Stats:\n\n"),
-			cmpPair->options.findUniqueMode ? TEXT("Find Unique") : TEXT("Compare"));
+	int infoCurrentPos = _sntprintf_s(info, _countof(info), _TRUNCATE, TEXT("%s Stats%s:\n\n"),
+			cmpPair->options.findUniqueMode ? TEXT("Find Unique") : TEXT("Compare"),
+			cmpPair->summary.approximate ? TEXT(" (approximate)") : TEXT(""));
 
 	TCHAR buf[256];
 
@@ -2978,6 +2986,15 @@ void BestSeqChangedLines()
 }
 
 
+void HistogramDiff()
+{
+	Settings.HistogramDiff = !Settings.HistogramDiff;
+	::SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[CMD_HISTOGRAM_DIFF]._cmdID,
+			(LPARAM)Settings.HistogramDiff);
+	Settings.markAsDirty();
+}
+
+
 void IgnoreSpaces()
 {
 	Settings.IgnoreSpaces = !Settings.IgnoreSpaces;
@@ -3331,6 +3348,9 @@ void createMenu()
 			TEXT("Detect Changed Lines by Best Matching Sequence"));
 	funcItem[CMD_BEST_SEQ_CHANGED_LINES]._pFunc = BestSeqChangedLines;
 
+	_tcscpy_s(funcItem[CMD_HISTOGRAM_DIFF]._itemName, nbChar, TEXT("Use Histogram Diff Algorithm"));
+	funcItem[CMD_HISTOGRAM_DIFF]._pFunc = HistogramDiff;
+
 	_tcscpy_s(funcItem[CMD_IGNORE_SPACES]._itemName, nbChar, TEXT("Ignore Spaces"));
 	funcItem[CMD_IGNORE_SPACES]._pFunc = IgnoreSpaces;
 
@@ -3699,6 +3719,8 @@ void onNppReady()
 			(LPARAM)Settings.DetectCharDiffs);
 	::SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[CMD_BEST_SEQ_CHANGED_LINES]._cmdID,
 			(LPARAM)Settings.BestSeqChangedLines);
+	::SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[CMD_HISTOGRAM_DIFF]._cmdID,
+			(LPARAM)Settings.HistogramDiff);
 	::SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[CMD_IGNORE_SPACES]._cmdID,
 			(LPARAM)Settings.IgnoreSpaces);
 	::SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[CMD_IGNORE_EMPTY_LINES]._cmdID,
@@ -132,6 +132,7 @@ enum MENU_COMMANDS
 	CMD_DETECT_MOVES,
 	CMD_DETECT_CHAR_DIFFS,
 	CMD_BEST_SEQ_CHANGED_LINES,
+	CMD_HISTOGRAM_DIFF,
 	CMD_SEPARATOR_4,
 	CMD_IGNORE_SPACES,
 	CMD_IGNORE_EMPTY_LINES,
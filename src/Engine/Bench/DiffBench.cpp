@@ -0,0 +1,170 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// DiffCalc micro-benchmark - measures the (histogram) diff and the post-processing (diffs combining and boundaries
+// shifting) times on sequences of line IDs with a small change every few elements (many hunks):
+//
+//   DiffBench [--size <elements>] [--change-every <elements>] [--repeat <count>]
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "diff.h"
+
+
+namespace {
+
+// Unique IDs (as code lines) mixed with a few repetitive ones (as empty lines and closing braces) - the hunks around
+// the repetitive IDs give the post-processing a lot to combine and shift
+void generateSequences(intptr_t size, intptr_t changeEvery, std::vector<uint32_t>& a, std::vector<uint32_t>& b)
+{
+	const uint32_t cRepetitiveIds = 4;
+
+	std::mt19937 rng(12345);
+	std::uniform_int_distribution<uint32_t> repetitiveId(0, cRepetitiveIds - 1);
+	std::uniform_int_distribution<intptr_t> gap(1, 2 * changeEvery - 1);
+	std::uniform_int_distribution<int> change(0, 2);
+
+	uint32_t uniqueId = cRepetitiveIds;
+
+	auto newId = [&]() { return (rng() & 1) ? uniqueId++ : repetitiveId(rng); };
+
+	a.resize(size);
+
+	for (auto& elem: a)
+		elem = newId();
+
+	b.reserve(size + size / changeEvery + 1);
+
+	for (intptr_t i = 0; i < size;)
+	{
+		const intptr_t next = i + gap(rng);
+
+		for (; i < next && i < size; ++i)
+			b.push_back(a[i]);
+
+		if (i == size)
+			break;
+
+		switch (change(rng))
+		{
+			case 0:		// deleted
+				++i;
+			break;
+
+			case 1:		// inserted
+				b.push_back(newId());
+			break;
+
+			default:	// changed
+				b.push_back(newId());
+				++i;
+		}
+	}
+}
+
+
+template <typename CompareFn>
+double measure(int repeat, size_t& hunks, CompareFn&& compareFn)
+{
+	double bestTime_ms = 0;
+
+	for (int r = 0; r < repeat; ++r)
+	{
+		const auto startTime = std::chrono::steady_clock::now();
+
+		hunks = compareFn();
+
+		const double time_ms =
+				std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+		if (r == 0 || time_ms < bestTime_ms)
+			bestTime_ms = time_ms;
+	}
+
+	return bestTime_ms;
+}
+
+}
+
+
+int main(int argc, char* argv[])
+{
+	intptr_t	size		= 1000000;
+	intptr_t	changeEvery	= 4;
+	int			repeat		= 3;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!std::strcmp(argv[i], "--size") && i + 1 < argc)
+			size = std::atoll(argv[++i]);
+		else if (!std::strcmp(argv[i], "--change-every") && i + 1 < argc)
+			changeEvery = std::atoll(argv[++i]);
+		else if (!std::strcmp(argv[i], "--repeat") && i + 1 < argc)
+			repeat = std::atoi(argv[++i]);
+		else
+		{
+			std::fprintf(stderr, "Usage: DiffBench [--size <elements>] [--change-every <elements>] [--repeat <count>]\n");
+			return 1;
+		}
+	}
+
+	if (size < 1 || changeEvery < 1 || repeat < 1)
+		return 1;
+
+	std::vector<uint32_t> a;
+	std::vector<uint32_t> b;
+
+	generateSequences(size, changeEvery, a, b);
+
+	std::printf("%lld / %lld elements, a change every %lld elements on average\n\n",
+			static_cast<long long>(a.size()), static_cast<long long>(b.size()), static_cast<long long>(changeEvery));
+
+	size_t rawHunks = 0;
+	size_t hunks = 0;
+
+	const double diffTime_ms = measure(repeat, rawHunks,
+			[&]()
+			{
+				DiffCalc<uint32_t> diffCalc(a, b);
+				diffCalc.set_bounded_cost(true);
+
+				return diffCalc(false, false, true, diff_algorithm::HISTOGRAM).first.size();
+			});
+
+	const double fullTime_ms = measure(repeat, hunks,
+			[&]()
+			{
+				DiffCalc<uint32_t> diffCalc(a, b);
+				diffCalc.set_bounded_cost(true);
+
+				return diffCalc(true, true, true, diff_algorithm::HISTOGRAM).first.size();
+			});
+
+	std::printf("diff:             %10.3f ms  %zu hunks\n", diffTime_ms, rawHunks);
+	// Both are measured with the diff so a very fast post-processing might come out as noise around 0
+	std::printf("post-processing:  %10.3f ms  %zu hunks\n",
+			(fullTime_ms > diffTime_ms) ? fullTime_ms - diffTime_ms : 0.0, hunks);
+
+	return 0;
+}
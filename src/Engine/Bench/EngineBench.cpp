@@ -0,0 +1,294 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Headless compare engine driver - compares two files the same way the plugin compares two views.
+// Used to benchmark, profile and regression-test the engine outside Notepad++:
+//
+//   EngineBench [options] <file1> <file2>
+//
+//   --ignore-spaces, --ignore-empty-lines, --ignore-case, --ignore-regex <regex>
+//   --no-moves, --char-diffs, --best-seq, --threshold <percent>, --find-unique
+//   --repeat <count>   run the compare several times and report the best time
+//   --marks            print all generated marks (for regression diffing of results)
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <clocale>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <exception>
+
+#include "Engine.h"
+
+
+namespace {
+
+/**
+ *  \class  MemoryDocument
+ *  \brief  Compare engine input held in memory
+ */
+class MemoryDocument : public DocumentSource
+{
+public:
+	MemoryDocument(std::string&& text) : _text(std::move(text)) {}
+
+	virtual const char* text() const
+	{
+		return _text.data();
+	}
+
+	virtual intptr_t length() const
+	{
+		return static_cast<intptr_t>(_text.size());
+	}
+
+	intptr_t lineCount() const
+	{
+		intptr_t count = 1;
+
+		for (size_t i = 0; i < _text.size(); ++i)
+		{
+			if (_text[i] == '\n' || (_text[i] == '\r' && (i + 1 == _text.size() || _text[i + 1] != '\n')))
+				++count;
+		}
+
+		return count;
+	}
+
+private:
+	const std::string _text;
+};
+
+
+/**
+ *  \class  CountingSink
+ *  \brief  Counts (and optionally prints) the compare engine marks
+ */
+class CountingSink : public DiffSink
+{
+public:
+	CountingSink(bool print) : _print(print) {}
+
+	virtual void clear(int)
+	{}
+
+	virtual void markLine(int view, intptr_t line, int markMask)
+	{
+		++markedLines;
+
+		if (_print)
+			std::printf("L %d %lld 0x%04X\n", view, static_cast<long long>(line + 1), markMask);
+	}
+
+	virtual void markLineChanges(int view, intptr_t line, const std::vector<section_t>& changes, int)
+	{
+		changedSections += static_cast<intptr_t>(changes.size());
+
+		if (_print)
+		{
+			for (const auto& change: changes)
+				std::printf("C %d %lld %lld %lld\n", view, static_cast<long long>(line + 1),
+						static_cast<long long>(change.off), static_cast<long long>(change.len));
+		}
+	}
+
+	intptr_t markedLines {0};
+	intptr_t changedSections {0};
+
+private:
+	const bool _print;
+};
+
+
+bool readFile(const char* path, std::string& text)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+
+	if (!file)
+		return false;
+
+	std::ostringstream content;
+	content << file.rdbuf();
+	text = content.str();
+
+	return true;
+}
+
+
+void printUsage()
+{
+	std::fprintf(stderr,
+			"Usage: EngineBench [options] <file1> <file2>\n"
+			"  --ignore-spaces  --ignore-empty-lines  --ignore-case  --ignore-regex <regex>\n"
+			"  --no-moves  --char-diffs  --fast-char-diffs  --best-seq  --histogram  --discard-unmatched\n"
+			"  --minimal  --threshold <percent>  --find-unique  --repeat <count>  --threads <count>  --marks\n");
+}
+
+}
+
+
+int main(int argc, char* argv[])
+{
+	std::setlocale(LC_CTYPE, "");
+
+	CompareOptions options;
+
+	options.newFileViewId			= SUB_VIEW;
+	options.findUniqueMode			= false;
+	options.alignAllMatches			= false;
+	options.neverMarkIgnored		= false;
+	options.detectMoves				= true;
+	options.detectCharDiffs			= false;
+	options.fastCharDiffs			= false;
+	options.bestSeqChangedLines		= false;
+	options.histogramDiff			= false;
+	options.discardUnmatchedLines	= false;
+	options.minimalLinesDiff		= false;
+	options.ignoreSpaces			= false;
+	options.ignoreEmptyLines		= false;
+	options.ignoreCase				= false;
+	options.changedThresholdPercent	= 50;
+	options.selectionCompare		= false;
+
+	int		repeat = 1;
+	bool	printMarks = false;
+
+	std::vector<const char*> files;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+
+		if (!std::strcmp(arg, "--ignore-spaces"))
+			options.ignoreSpaces = true;
+		else if (!std::strcmp(arg, "--ignore-empty-lines"))
+			options.ignoreEmptyLines = true;
+		else if (!std::strcmp(arg, "--ignore-case"))
+			options.ignoreCase = true;
+		else if (!std::strcmp(arg, "--no-moves"))
+			options.detectMoves = false;
+		else if (!std::strcmp(arg, "--char-diffs"))
+			options.detectCharDiffs = true;
+		else if (!std::strcmp(arg, "--fast-char-diffs"))
+			options.fastCharDiffs = true;
+		else if (!std::strcmp(arg, "--best-seq"))
+			options.bestSeqChangedLines = true;
+		else if (!std::strcmp(arg, "--histogram"))
+			options.histogramDiff = true;
+		else if (!std::strcmp(arg, "--discard-unmatched"))
+			options.discardUnmatchedLines = true;
+		else if (!std::strcmp(arg, "--minimal"))
+			options.minimalLinesDiff = true;
+		else if (!std::strcmp(arg, "--find-unique"))
+			options.findUniqueMode = true;
+		else if (!std::strcmp(arg, "--marks"))
+			printMarks = true;
+		else if (!std::strcmp(arg, "--threshold") && i + 1 < argc)
+			options.changedThresholdPercent = std::atoi(argv[++i]);
+		else if (!std::strcmp(arg, "--repeat") && i + 1 < argc)
+			repeat = std::atoi(argv[++i]);
+		else if (!std::strcmp(arg, "--threads") && i + 1 < argc)
+			setWorkerThreads(std::atoi(argv[++i]));
+		else if (!std::strcmp(arg, "--ignore-regex") && i + 1 < argc)
+		{
+			const std::string regexStr = argv[++i];
+			options.setIgnoreRegex(std::wstring(regexStr.begin(), regexStr.end()));
+		}
+		else if (arg[0] == '-')
+		{
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			files.push_back(arg);
+		}
+	}
+
+	if (files.size() != 2 || repeat < 1)
+	{
+		printUsage();
+		return 1;
+	}
+
+	std::string text1;
+	std::string text2;
+
+	if (!readFile(files[0], text1) || !readFile(files[1], text2))
+	{
+		std::fprintf(stderr, "Cannot read input files\n");
+		return 1;
+	}
+
+	const MemoryDocument doc1(std::move(text1));
+	const MemoryDocument doc2(std::move(text2));
+
+	CompareResult	result = CompareResult::COMPARE_ERROR;
+	CompareSummary	summary;
+	double			bestTime_ms = 0;
+
+	try
+	{
+		for (int r = 0; r < repeat; ++r)
+		{
+			CountingSink sink(printMarks && (r == repeat - 1));
+
+			const auto startTime = std::chrono::steady_clock::now();
+
+			if (options.findUniqueMode)
+				result = runFindUnique(doc1, doc2, sink, options, summary);
+			else
+				result = runCompare(doc1, doc2, sink, options, summary);
+
+			const double time_ms =
+					std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+			if (r == 0 || time_ms < bestTime_ms)
+				bestTime_ms = time_ms;
+		}
+	}
+	catch (std::exception& e)
+	{
+		std::fprintf(stderr, "Exception occurred: %s\n", e.what());
+		return 2;
+	}
+
+	const char* resultStr =
+			(result == CompareResult::COMPARE_MATCH) ? "match" :
+			(result == CompareResult::COMPARE_MISMATCH) ? "mismatch" :
+			(result == CompareResult::COMPARE_CANCELLED) ? "cancelled" : "error";
+
+	std::printf("result: %s\nlines: %lld / %lld\ntime: %.3f ms\n", resultStr,
+			static_cast<long long>(doc1.lineCount()), static_cast<long long>(doc2.lineCount()), bestTime_ms);
+
+	if (result == CompareResult::COMPARE_MISMATCH)
+		std::printf("diff lines: %lld\nadded: %lld\nremoved: %lld\nmoved: %lld\nchanged: %lld\nmatch: %lld\n",
+				static_cast<long long>(summary.diffLines), static_cast<long long>(summary.added),
+				static_cast<long long>(summary.removed), static_cast<long long>(summary.moved),
+				static_cast<long long>(summary.changed), static_cast<long long>(summary.match));
+
+	if (result == CompareResult::COMPARE_MISMATCH && summary.approximate)
+		std::printf("approximate\n");
+
+	return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Line hash kernels micro-benchmark - measures the throughput of the per-byte Hash() loop and of all line hash
+// kernels supported by the CPU on random text lines:
+//
+//   HashBench [--line-len <avg bytes>] [--size <MB>] [--repeat <count>]
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "LineHash.h"
+
+
+namespace {
+
+struct LineRef
+{
+	intptr_t off;
+	intptr_t len;
+};
+
+
+// The line hashing loop used before the kernels
+uint64_t perByteHash(uint64_t hashSeed, const char* line, intptr_t len, bool ignoreSpaces, bool ignoreCase)
+{
+	for (intptr_t i = 0; i < len; ++i)
+	{
+		char ch = line[i];
+
+		if (ignoreSpaces && (ch == ' ' || ch == '\t'))
+			continue;
+
+		if (ignoreCase && ch >= 'A' && ch <= 'Z')
+			ch += 'a' - 'A';
+
+		hashSeed = Hash(hashSeed, ch);
+	}
+
+	return hashSeed;
+}
+
+
+void generateText(intptr_t size, intptr_t avgLineLen, std::string& text, std::vector<LineRef>& lines)
+{
+	static const char cChars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_(){};=+-*/<>,.";
+
+	std::mt19937 rng(12345);
+	std::uniform_int_distribution<int> lineLen(0, static_cast<int>(2 * avgLineLen));
+	std::uniform_int_distribution<int> wordLen(1, 12);
+	std::uniform_int_distribution<int> charIdx(0, sizeof(cChars) - 2);
+	std::uniform_int_distribution<int> indent(0, 3);
+
+	text.reserve(size + 2 * avgLineLen + 64);
+
+	while (static_cast<intptr_t>(text.size()) < size)
+	{
+		LineRef line;
+		line.off = static_cast<intptr_t>(text.size());
+
+		const intptr_t len = lineLen(rng);
+
+		text.append(indent(rng), '\t');
+
+		while (static_cast<intptr_t>(text.size()) - line.off < len)
+		{
+			for (int i = wordLen(rng); i > 0; --i)
+				text.push_back(cChars[charIdx(rng)]);
+
+			text.push_back(' ');
+		}
+
+		line.len = static_cast<intptr_t>(text.size()) - line.off;
+		lines.push_back(line);
+
+		text.push_back('\n');
+	}
+}
+
+
+// Keeps the hash results used so the measured loops are not optimized away
+volatile uint64_t resultsSink = 0;
+
+
+template <typename HashFn>
+double measure(const std::string& text, const std::vector<LineRef>& lines, int repeat, uint64_t& result,
+		HashFn&& hashFn)
+{
+	double bestTime_s = 0;
+
+	for (int r = 0; r < repeat; ++r)
+	{
+		uint64_t sum = 0;
+
+		const auto startTime = std::chrono::steady_clock::now();
+
+		for (const auto& line: lines)
+			sum += hashFn(text.data() + line.off, line.len);
+
+		const double time_s =
+				std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+		if (r == 0 || time_s < bestTime_s)
+			bestTime_s = time_s;
+
+		result = sum;
+		resultsSink = sum;
+	}
+
+	return (static_cast<double>(text.size()) / bestTime_s) / 1e9;
+}
+
+}
+
+
+int main(int argc, char* argv[])
+{
+	intptr_t	avgLineLen	= 40;
+	intptr_t	size_MB		= 64;
+	int			repeat		= 5;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!std::strcmp(argv[i], "--line-len") && i + 1 < argc)
+			avgLineLen = std::atoi(argv[++i]);
+		else if (!std::strcmp(argv[i], "--size") && i + 1 < argc)
+			size_MB = std::atoi(argv[++i]);
+		else if (!std::strcmp(argv[i], "--repeat") && i + 1 < argc)
+			repeat = std::atoi(argv[++i]);
+		else
+		{
+			std::fprintf(stderr, "Usage: HashBench [--line-len <avg bytes>] [--size <MB>] [--repeat <count>]\n");
+			return 1;
+		}
+	}
+
+	if (avgLineLen < 1 || size_MB < 1 || repeat < 1)
+		return 1;
+
+	std::string text;
+	std::vector<LineRef> lines;
+
+	generateText(size_MB * 1024 * 1024, avgLineLen, text, lines);
+
+	std::printf("%lld lines, %.1f MB, average line length %lld\n\n", static_cast<long long>(lines.size()),
+			text.size() / (1024.0 * 1024.0), static_cast<long long>(avgLineLen));
+
+	const struct
+	{
+		const char*	name;
+		bool		ignoreSpaces;
+		bool		ignoreCase;
+	} modes[] = {
+		{ "plain",			false,	false },
+		{ "ignore spaces",	true,	false },
+		{ "ignore case",	false,	true },
+		{ "ignore both",	true,	true }
+	};
+
+	const struct
+	{
+		const char*	name;
+		HashKernel	kernel;
+	} kernels[] = {
+		{ "scalar",	HashKernel::SCALAR },
+		{ "SSE2",	HashKernel::SSE2 },
+		{ "AVX2",	HashKernel::AVX2 }
+	};
+
+	std::printf("%-16s%12s", "mode", "per-byte");
+
+	for (const auto& k: kernels)
+		if (isHashKernelSupported(k.kernel))
+			std::printf("%12s", k.name);
+
+	std::printf("   (GB/s)\n");
+
+	int ret = 0;
+
+	for (const auto& mode: modes)
+	{
+		uint64_t result = 0;
+
+		std::printf("%-16s%12.2f", mode.name, measure(text, lines, repeat, result,
+				[&](const char* line, intptr_t len)
+				{
+					return perByteHash(cHashSeed, line, len, mode.ignoreSpaces, mode.ignoreCase);
+				}));
+
+		uint64_t kernelsResult = 0;
+
+		for (const auto& k: kernels)
+		{
+			if (!isHashKernelSupported(k.kernel))
+				continue;
+
+			std::printf("%12.2f", measure(text, lines, repeat, result,
+					[&](const char* line, intptr_t len)
+					{
+						return hashLine(k.kernel, cHashSeed, line, len, mode.ignoreSpaces, mode.ignoreCase);
+					}));
+
+			// All kernels must give the same hashes
+			if (k.kernel == HashKernel::SCALAR)
+				kernelsResult = result;
+			else if (result != kernelsResult)
+				ret = 2;
+		}
+
+		std::printf("\n");
+	}
+
+	if (ret)
+		std::printf("\nERROR: kernels results differ!\n");
+
+	return ret;
+}
@@ -19,8 +19,12 @@
 
 #define NOMINMAX
 
+#include <atomic>
+#include <bitset>
 #include <climits>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <exception>
 #include <utility>
 #include <vector>
@@ -31,11 +35,18 @@
 #include <algorithm>
 #include <functional>
 
-#include <windows.h>
-
 #include "Engine.h"
+#include "LineHash.h"
+#include "TextHelpers.h"
 #include "diff.h"
-#include "ProgressDlg.h"
+
+#if defined(DLOG) && defined(_WIN32)
+#include "Compare.h"
+#else
+#define LOGD_GET_TIME
+#define LOGD(LOG_FILTER, STR)
+#define PRINT_DIFFS(INFO, DIFFS)
+#endif
 
 // #define MULTITHREAD		1
 
@@ -49,6 +60,8 @@
 #include <mutex>
 #endif // __MINGW32__ ...
 
+#include "ThreadPool.h"
+
 #endif // MULTITHREAD
 
 
@@ -74,9 +87,113 @@ private:
 	std::mutex& _mtx;
 };
 
+
+// The engine's pool workers and the calling thread
+inline int getWorkersCount()
+{
+	return ThreadPool::workersCount() + 1;
+}
+
+
+// Runs jobFn(job, slot) for all jobs in [0, jobsCount) on up to threadsCount threads of the engine's pool (the
+// calling thread included). Jobs of the same slot run one after another
+template <typename JobFn>
+inline void parallelFor(intptr_t jobsCount, int threadsCount, JobFn&& jobFn)
+{
+	ThreadPool::parallelFor(jobsCount, threadsCount, jobFn);
+}
+
+#else
+
+inline int getWorkersCount()
+{
+	return 1;
+}
+
+
+template <typename JobFn>
+inline void parallelFor(intptr_t jobsCount, int, JobFn&& jobFn)
+{
+	for (intptr_t job = 0; job < jobsCount; ++job)
+		jobFn(job, 0);
+}
+
 #endif // MULTITHREAD
 
 
+// DiffCalc's tasks runner - its parallel parts run as jobs of the engine's pool
+void runDiffTasks(int tasksCount, const std::function<void(int)>& task)
+{
+	parallelFor(tasksCount, tasksCount, [&task](intptr_t job, int) { task(static_cast<int>(job)); });
+}
+
+
+/**
+ *  \class  SharedProgress
+ *  \brief  Progress advanced by concurrent workers. Their counts are added up lock-free and whichever worker finds
+ *          the wrapped progress free reports the pending count so the workers never wait for each other. The other
+ *          methods are for the owning thread only
+ */
+class SharedProgress : public CompareProgress
+{
+public:
+	SharedProgress(CompareProgress& progress) : _progress(progress) {}
+
+	virtual void Show()
+	{
+		_progress.Show();
+	}
+
+	virtual bool IsCancelled() const
+	{
+		return _cancelled.load(std::memory_order_relaxed);
+	}
+
+	virtual unsigned NextPhase()
+	{
+		return _progress.NextPhase();
+	}
+
+	virtual bool SetMaxCount(intptr_t max)
+	{
+		return _progress.SetMaxCount(max);
+	}
+
+	virtual bool Advance(intptr_t cnt = 1)
+	{
+		_pending.fetch_add(cnt, std::memory_order_relaxed);
+
+#ifdef MULTITHREAD
+		std::unique_lock<std::mutex> lock(_mtx, std::try_to_lock);
+
+		if (!lock.owns_lock())
+			return !IsCancelled();
+#endif
+
+		if (!_progress.Advance(_pending.exchange(0, std::memory_order_relaxed)))
+			_cancelled.store(true, std::memory_order_relaxed);
+
+		return !IsCancelled();
+	}
+
+	// Reports the count left pending by the workers - to be called after they finish
+	inline bool flush()
+	{
+		return Advance(0);
+	}
+
+private:
+	CompareProgress& _progress;
+
+	std::atomic<intptr_t>	_pending {0};
+	std::atomic<bool>		_cancelled {false};
+
+#ifdef MULTITHREAD
+	std::mutex				_mtx;
+#endif
+};
+
+
 enum class charType
 {
 	SPACECHAR,
@@ -171,14 +288,414 @@ struct Char
 };
 
 
+/**
+ *  \class  CharsLcs
+ *  \brief  Bit-parallel (Allison-Dix / Hyyro) LCS of a line's chars and other lines' chars. The LCS length is the
+ *          matched chars count of their minimal diff but needs no edit script. Short sections' edit scripts can be
+ *          traced from the LCS bit-vectors too (see diffChars()). The line's chars match bit-masks are built once for
+ *          all compared lines
+ */
+class CharsLcs
+{
+public:
+	static const intptr_t cMaxSize = 256;
+	// Longest other chars an edit script is traced for - the thread keeps the trace's bit-vectors for the next one
+	static const intptr_t cMaxOtherSize = 4096;
+
+	// chars must not be longer than cMaxSize
+	CharsLcs(const std::vector<Char>& chars);
+
+	intptr_t length(const std::vector<Char>& other) const;
+
+	// Minimal edit script - DIFF_MATCH and DIFF_IN_1 offsets are into the line's chars, DIFF_IN_2 into other.
+	// other must not be longer than cMaxOtherSize
+	std::vector<diff_info<void>> diff(const std::vector<Char>& other) const;
+
+private:
+	static const intptr_t cWordBits = 64;
+	static const intptr_t cMaxWords = cMaxSize / cWordBits;
+
+	struct CharMask
+	{
+		wchar_t		ch;
+		uint64_t	bits[cMaxWords];
+	};
+
+	inline intptr_t _maskIdx(wchar_t ch) const;
+	inline void _advance(uint64_t* v, const uint64_t* mask) const;
+
+	intptr_t	_size;
+	intptr_t	_words;
+
+	// Index + 1 in _masks of the ASCII chars (0 if not in the line) - the others are searched for in _masks
+	uint16_t	_asciiIdx[128];
+
+	// Bit (_size - 1 - i) stands for the line's char i so the low bits hold the line's suffixes
+	std::vector<CharMask>	_masks;
+};
+
+
+CharsLcs::CharsLcs(const std::vector<Char>& chars) :
+	_size(static_cast<intptr_t>(chars.size())), _words((_size + cWordBits - 1) / cWordBits)
+{
+	std::memset(_asciiIdx, 0, sizeof(_asciiIdx));
+
+	_masks.reserve(_size);
+
+	for (intptr_t i = 0; i < _size; ++i)
+	{
+		const wchar_t ch = chars[i].ch;
+
+		intptr_t idx = _maskIdx(ch);
+
+		if (idx < 0)
+		{
+			idx = static_cast<intptr_t>(_masks.size());
+
+			_masks.emplace_back();
+			_masks[idx].ch = ch;
+			std::memset(_masks[idx].bits, 0, sizeof(_masks[idx].bits));
+
+			if (static_cast<unsigned>(ch) < 128)
+				_asciiIdx[ch] = static_cast<uint16_t>(idx + 1);
+		}
+
+		const intptr_t bit = _size - 1 - i;
+
+		_masks[idx].bits[bit / cWordBits] |= uint64_t(1) << (bit % cWordBits);
+	}
+}
+
+
+inline intptr_t CharsLcs::_maskIdx(wchar_t ch) const
+{
+	if (static_cast<unsigned>(ch) < 128)
+		return static_cast<intptr_t>(_asciiIdx[ch]) - 1;
+
+	const intptr_t masksCount = static_cast<intptr_t>(_masks.size());
+
+	for (intptr_t i = 0; i < masksCount; ++i)
+	{
+		if (_masks[i].ch == ch)
+			return i;
+	}
+
+	return -1;
+}
+
+
+// v = (v + (v & mask)) | (v & ~mask) with the addition carried through all words
+inline void CharsLcs::_advance(uint64_t* v, const uint64_t* mask) const
+{
+	uint64_t carry = 0;
+
+	for (intptr_t w = 0; w < _words; ++w)
+	{
+		const uint64_t u = v[w] & mask[w];
+		const uint64_t sum1 = v[w] + carry;
+		const uint64_t sum = sum1 + u;
+
+		carry = (sum1 < carry) | (sum < u);
+		v[w] = sum | (v[w] & ~mask[w]);
+	}
+}
+
+
+// other is processed backwards so v's low bits zeros count is the LCS length of the line's and other's suffixes
+intptr_t CharsLcs::length(const std::vector<Char>& other) const
+{
+	uint64_t v[cMaxWords];
+
+	for (intptr_t w = 0; w < _words; ++w)
+		v[w] = ~uint64_t(0);
+
+	for (auto c = other.rbegin(); c != other.rend(); ++c)
+	{
+		const intptr_t idx = _maskIdx(c->ch);
+
+		if (idx >= 0)
+			_advance(v, _masks[idx].bits);
+	}
+
+	intptr_t len = 0;
+
+	for (intptr_t w = 0; w < _words; ++w)
+	{
+		uint64_t matched = ~v[w];
+
+		if ((w + 1) * cWordBits > _size)
+			matched &= (uint64_t(1) << (_size % cWordBits)) - 1;
+
+		len += static_cast<intptr_t>(std::bitset<cWordBits>(matched).count());
+	}
+
+	return len;
+}
+
+
+// Traced forward with v of each other's suffix kept - a line's char is skipped (unmatched) if its v bit is set, that is
+// the LCS of the remaining suffixes does not need it. The matches are taken as early as possible and each change is
+// DIFF_IN_1 followed by DIFF_IN_2 as in DiffCalc. Equal cost scripts are not chosen as DiffCalc's Hirschberg recursion
+// would choose them
+std::vector<diff_info<void>> CharsLcs::diff(const std::vector<Char>& other) const
+{
+	const intptr_t otherSize = static_cast<intptr_t>(other.size());
+
+	// v of other's suffix from j is at j * _words - never more than (cMaxOtherSize + 1) * cMaxWords kept
+	static thread_local std::vector<uint64_t> suffixesV;
+
+	suffixesV.resize((otherSize + 1) * _words);
+
+	uint64_t* const v = suffixesV.data();
+
+	for (intptr_t w = 0; w < _words; ++w)
+		v[otherSize * _words + w] = ~uint64_t(0);
+
+	for (intptr_t j = otherSize - 1; j >= 0; --j)
+	{
+		std::memcpy(v + j * _words, v + (j + 1) * _words, _words * sizeof(uint64_t));
+
+		const intptr_t idx = _maskIdx(other[j].ch);
+
+		if (idx >= 0)
+			_advance(v + j * _words, _masks[idx].bits);
+	}
+
+	std::vector<diff_info<void>> diffs;
+
+	auto addDiff =
+		[&](diff_type type, intptr_t off, intptr_t len)
+		{
+			if (len)
+				diffs.push_back({ type, off, len });
+		};
+
+	intptr_t i = 0;
+	intptr_t j = 0;
+
+	// Start of the current change and of the current match
+	intptr_t ci = 0;
+	intptr_t cj = 0;
+	intptr_t mi = 0;
+
+	while (i < _size && j < otherSize)
+	{
+		const intptr_t bit = _size - 1 - i;
+		const uint64_t bitMask = uint64_t(1) << (bit % cWordBits);
+
+		const intptr_t idx = _maskIdx(other[j].ch);
+
+		if (idx >= 0 && (_masks[idx].bits[bit / cWordBits] & bitMask))
+		{
+			if (ci != i || cj != j)
+			{
+				addDiff(diff_type::DIFF_MATCH, mi, ci - mi);
+				addDiff(diff_type::DIFF_IN_1, ci, i - ci);
+				addDiff(diff_type::DIFF_IN_2, cj, j - cj);
+
+				mi = i;
+			}
+
+			ci = ++i;
+			cj = ++j;
+		}
+		else if (v[j * _words + bit / cWordBits] & bitMask)
+		{
+			++i;
+		}
+		else
+		{
+			++j;
+		}
+	}
+
+	if (ci != _size || cj != otherSize)
+	{
+		addDiff(diff_type::DIFF_MATCH, mi, ci - mi);
+		addDiff(diff_type::DIFF_IN_1, ci, _size - ci);
+		addDiff(diff_type::DIFF_IN_2, cj, otherSize - cj);
+	}
+	else
+	{
+		addDiff(diff_type::DIFF_MATCH, mi, ci - mi);
+	}
+
+	return diffs;
+}
+
+
+// Char diffs are DiffCalc's unless options.fastCharDiffs is set. Then short sections' char diffs are traced from their
+// bit-parallel LCS - as DiffCalc the shorter section is the first (swapped otherwise) and equal sized sections are
+// compared both ways keeping the result with more replacements. The script is as minimal but equal cost alternatives
+// are chosen differently (the matches are taken as early as possible) so some char diffs are marked differently
+std::pair<std::vector<diff_info<void>>, bool> diffChars(const std::vector<Char>& chars1,
+		const std::vector<Char>& chars2, const CompareOptions& options)
+{
+	const bool swapped = (chars1.size() > chars2.size());
+
+	const std::vector<Char>& shorter	= swapped ? chars2 : chars1;
+	const std::vector<Char>& longer		= swapped ? chars1 : chars2;
+
+	if (!options.fastCharDiffs || static_cast<intptr_t>(shorter.size()) > CharsLcs::cMaxSize ||
+			static_cast<intptr_t>(longer.size()) > CharsLcs::cMaxOtherSize)
+		return DiffCalc<Char>(chars1, chars2)();
+
+	auto res = std::make_pair(CharsLcs(shorter).diff(longer), swapped);
+
+	if (chars1.size() == chars2.size())
+	{
+		std::vector<diff_info<void>> swappedDiffs = CharsLcs(chars2).diff(chars1);
+
+		if (DiffCalc<Char>::count_replaces(swappedDiffs) >= DiffCalc<Char>::count_replaces(res.first))
+		{
+			res.first = std::move(swappedDiffs);
+			res.second = true;
+		}
+	}
+
+	return res;
+}
+
+
+/**
+ *  \class  TextSnapshot
+ *  \brief  Read-only view of the whole document text plus line offsets index, taken once at compare start
+ */
+class TextSnapshot
+{
+public:
+	void take(const DocumentSource& src)
+	{
+		_text	= src.text();
+		_len	= src.length();
+
+		_lineStarts.clear();
+		_lineStarts.push_back(0);
+
+		if (_len <= 0)
+			return;
+
+		intptr_t nextLf = -1;
+		intptr_t nextCr = -1;
+
+		// Line ends are CR, LF or CRLF - the same as Scintilla's
+		for (intptr_t pos = 0; pos < _len;)
+		{
+			if (nextLf < pos)
+				nextLf = findChar(pos, '\n');
+
+			if (nextCr < pos)
+				nextCr = findChar(pos, '\r');
+
+			intptr_t eol = std::min(nextLf, nextCr);
+
+			if (eol == _len)
+				break;
+
+			if (eol == nextCr && eol + 1 < _len && _text[eol + 1] == '\n')
+				++eol;
+
+			pos = eol + 1;
+			_lineStarts.push_back(pos);
+		}
+	}
+
+	inline const char* data() const
+	{
+		return _text;
+	}
+
+	inline intptr_t length() const
+	{
+		return _len;
+	}
+
+	inline intptr_t linesCount() const
+	{
+		return (_len > 0) ? static_cast<intptr_t>(_lineStarts.size()) : 0;
+	}
+
+	inline intptr_t lineStart(intptr_t line) const
+	{
+		return _lineStarts[line];
+	}
+
+	// Line end position excluding the EOL chars
+	inline intptr_t lineEnd(intptr_t line) const
+	{
+		if (line + 1 >= static_cast<intptr_t>(_lineStarts.size()))
+			return _len;
+
+		intptr_t end = _lineStarts[line + 1] - 1;
+
+		if (_text[end] == '\n' && end > _lineStarts[line] && _text[end - 1] == '\r')
+			--end;
+
+		return end;
+	}
+
+private:
+	inline intptr_t findChar(intptr_t pos, char ch) const
+	{
+		const char* found = static_cast<const char*>(std::memchr(_text + pos, ch, _len - pos));
+
+		return found ? (found - _text) : _len;
+	}
+
+	const char*				_text {nullptr};
+	intptr_t				_len {0};
+	std::vector<intptr_t>	_lineStarts;
+};
+
+
+// Compile-time options of the text extraction functions - each combination gets its own instantiation so the per
+// line and per char loops carry no options checks
+enum : unsigned
+{
+	TEXT_IGNORE_SPACES		= 0x1,
+	TEXT_IGNORE_CASE		= 0x2,
+	TEXT_IGNORE_EMPTY_LINES	= 0x4,
+	TEXT_IGNORE_REGEX		= 0x8,
+
+	TEXT_OPTIONS_COMBINATIONS	= 0x10
+};
+
+
+struct DocCmpInfo;
+
+
+/**
+ *  \struct TextExtractor
+ *  \brief  Lines hashing, words and chars extraction instantiated for one compare options combination
+ */
+struct TextExtractor
+{
+	intptr_t (*hashLines)(DocCmpInfo& doc, intptr_t startLine, intptr_t endLine, const CompareOptions& options);
+
+	std::vector<Word> (*getLineWords)(const TextSnapshot& text, intptr_t docLine, const CompareOptions& options);
+
+	// Section chars ignoring spaces and case only
+	std::vector<Char> (*getSectionChars)(const TextSnapshot& text, intptr_t secStart, intptr_t secEnd,
+			const CompareOptions& options);
+
+	// Line chars with the regex ignored parts removed as well
+	std::vector<Char> (*getLineChars)(const TextSnapshot& text, intptr_t lineStart, intptr_t lineEnd,
+			const CompareOptions& options);
+};
+
+
 struct DocCmpInfo
 {
-	int			view;
-	section_t	section;
+	int					view;
+	const TextSnapshot*	text;
+	section_t			section;
 
-	int			blockDiffMask;
+	const TextExtractor*	extractor;
+
+	int						blockDiffMask;
 
 	std::vector<Line>				lines;
+	std::vector<uint32_t>			lineIds; // lines' equivalence class IDs - set by internLines()
 	std::unordered_set<intptr_t>	nonUniqueLines;
 };
 
@@ -323,19 +840,6 @@ struct LinesConv
 };
 
 
-const uint64_t cHashSeed = 0x84222325;
-
-template<typename CharT>
-inline uint64_t Hash(uint64_t hval, CharT letter)
-{
-	hval ^= static_cast<uint64_t>(letter);
-
-	hval += (hval << 1) + (hval << 4) + (hval << 5) + (hval << 7) + (hval << 8) + (hval << 40);
-
-	return hval;
-}
-
-
 inline intptr_t toAlignmentLine(const DocCmpInfo& doc, intptr_t bdLine)
 {
 	if (doc.lines.empty())
@@ -352,32 +856,27 @@ inline intptr_t toAlignmentLine(const DocCmpInfo& doc, intptr_t bdLine)
 void swap(DocCmpInfo& lhs, DocCmpInfo& rhs)
 {
 	std::swap(lhs.view, rhs.view);
+	std::swap(lhs.text, rhs.text);
 	std::swap(lhs.section, rhs.section);
+	std::swap(lhs.extractor, rhs.extractor);
 	std::swap(lhs.blockDiffMask, rhs.blockDiffMask);
 	std::swap(lhs.lines, rhs.lines);
+	std::swap(lhs.lineIds, rhs.lineIds);
 	std::swap(lhs.nonUniqueLines, rhs.nonUniqueLines);
 }
 
 
-inline uint64_t lineRangeHash(uint64_t hashSeed, std::vector<wchar_t>& line, intptr_t pos, intptr_t endPos,
-		const CompareOptions& options)
+template <unsigned Opts>
+inline uint64_t lineRangeHash(uint64_t hashSeed, std::vector<wchar_t>& line, intptr_t pos, intptr_t endPos)
 {
 	if (pos < endPos)
 	{
-		if (options.ignoreCase)
-		{
-			const wchar_t storedChar = line[endPos];
-
-			line[endPos] = L'\0';
-
-			::CharLowerW((LPWSTR)line.data() + pos);
-
-			line[endPos] = storedChar;
-		}
+		if (Opts & TEXT_IGNORE_CASE)
+			toLowerCase(line.data() + pos, endPos - pos);
 
 		for (; pos < endPos; ++pos)
 		{
-			if (options.ignoreSpaces && (line[pos] == L' ' || line[pos] == L'\t'))
+			if ((Opts & TEXT_IGNORE_SPACES) && (line[pos] == L' ' || line[pos] == L'\t'))
 				continue;
 
 			hashSeed = Hash(hashSeed, line[pos]);
@@ -388,18 +887,15 @@ inline uint64_t lineRangeHash(uint64_t hashSeed, std::vector<wchar_t>& line, int
 }
 
 
-uint64_t regexIgnoreLineHash(uint64_t hashSeed, const std::vector<char>& line, const CompareOptions& options)
+template <unsigned Opts>
+uint64_t regexIgnoreLineHash(uint64_t hashSeed, const char* line, intptr_t len, const CompareOptions& options)
 {
-	const intptr_t len = static_cast<intptr_t>(line.size());
-
 	if (len == 0)
 		return hashSeed;
 
-	const int wLen = ::MultiByteToWideChar(CP_UTF8, 0, line.data(), len, NULL, 0);
-
-	std::vector<wchar_t> wLine(wLen);
+	std::vector<wchar_t> wLine = toWideChar(line, len);
 
-	::MultiByteToWideChar(CP_UTF8, 0, line.data(), len, wLine.data(), wLen);
+	const intptr_t wLen = static_cast<intptr_t>(wLine.size());
 
 #ifndef MULTITHREAD
 	LOGD(LOG_ALGO, "line len " + std::to_string(len) + " to wide char len " + std::to_string(wLen) + "\n");
@@ -416,87 +912,167 @@ uint64_t regexIgnoreLineHash(uint64_t hashSeed, const std::vector<char>& line, c
 		LOGD(LOG_ALGO, "pos " + std::to_string(rit->position()) + ", len " + std::to_string(rit->length()) + "\n");
 #endif
 
-		hashSeed = lineRangeHash(hashSeed, wLine, pos, rit->position(), options);
+		hashSeed = lineRangeHash<Opts>(hashSeed, wLine, pos, rit->position());
 
 		pos = rit->position() + rit->length();
 		++rit;
 	}
 
-	hashSeed = lineRangeHash(hashSeed, wLine, pos, len - 1, options);
+	hashSeed = lineRangeHash<Opts>(hashSeed, wLine, pos, wLen);
 
 	return hashSeed;
 }
 
 
-void getLines(DocCmpInfo& doc, const CompareOptions& options)
+// Hashes section lines [startLine, endLine) storing them in doc.lines from startLine on.
+// Returns the number of stored lines (less than the range if ignoring empty lines)
+template <unsigned Opts>
+intptr_t hashLines(DocCmpInfo& doc, intptr_t startLine, intptr_t endLine, const CompareOptions& options)
 {
-	const int monitorCancelEveryXLine = 500;
+	const bool ignoreSpaces	= ((Opts & TEXT_IGNORE_SPACES) != 0);
+	const bool ignoreCase	= ((Opts & TEXT_IGNORE_CASE) != 0);
 
-	progress_ptr& progress = ProgressDlg::Get();
+	// Case folding buffer reused for the non-ASCII lines
+	std::vector<char> lowerLine;
 
-	doc.lines.clear();
+	Line* out = doc.lines.data() + startLine;
 
-	intptr_t linesCount = CallScintilla(doc.view, SCI_GETLENGTH, 0, 0);
-
-	if (linesCount)
-		linesCount = CallScintilla(doc.view, SCI_GETLINECOUNT, 0, 0);
-	else
-		return;
-
-	if ((doc.section.len <= 0) || (doc.section.off + doc.section.len > linesCount))
-		doc.section.len = linesCount - doc.section.off;
-
-	if (progress)
-		progress->SetMaxCount((doc.section.len / monitorCancelEveryXLine) + 1);
-
-	doc.lines.reserve(doc.section.len);
-
-	for (intptr_t secLine = 0; secLine < doc.section.len; ++secLine)
+	for (intptr_t secLine = startLine; secLine < endLine; ++secLine)
 	{
-		if (progress && (secLine % monitorCancelEveryXLine == 0) && !progress->Advance())
-		{
-			doc.lines.clear();
-			return;
-		}
-
 		const intptr_t docLine		= secLine + doc.section.off;
-		const intptr_t lineStart	= getLineStart(doc.view, docLine);
-		const intptr_t lineEnd		= getLineEnd(doc.view, docLine);
+		const intptr_t lineStart	= doc.text->lineStart(docLine);
+		const intptr_t lineLen		= doc.text->lineEnd(docLine) - lineStart;
 
 		Line newLine;
 		newLine.hash = cHashSeed;
 		newLine.line = docLine;
 
-		if (lineStart < lineEnd)
+		if (lineLen > 0)
 		{
-			std::vector<char> line = getText(doc.view, lineStart, lineEnd);
+			const char* line = doc.text->data() + lineStart;
 
-			if (options.ignoreRegex)
+			if (Opts & TEXT_IGNORE_REGEX)
 			{
 #ifndef MULTITHREAD
 				LOGD(LOG_ALGO, "Regex Ignore on line " + std::to_string(docLine + 1) +
 						", view " + std::to_string(doc.view) + "\n");
 #endif
 
-				newLine.hash = regexIgnoreLineHash(newLine.hash, line, options);
+				newLine.hash = regexIgnoreLineHash<Opts>(newLine.hash, line, lineLen, options);
 			}
 			else
 			{
-				if (options.ignoreCase)
-					toLowerCase(line);
+				intptr_t len = lineLen;
 
-				for (intptr_t i = 0; i < lineEnd - lineStart; ++i)
+				if (ignoreCase && !isAscii(line, len))
 				{
-					if (options.ignoreSpaces && (line[i] == ' ' || line[i] == '\t'))
-						continue;
+					lowerLine.assign(line, line + len);
+					toLowerCase(lowerLine);
 
-					newLine.hash = Hash(newLine.hash, line[i]);
+					line	= lowerLine.data();
+					len		= static_cast<intptr_t>(lowerLine.size());
 				}
+
+				newLine.hash = hashLine<ignoreSpaces, ignoreCase>(newLine.hash, line, len);
 			}
 		}
 
-		if (!options.ignoreEmptyLines || newLine.hash != cHashSeed)
-			doc.lines.emplace_back(newLine);
+		if (!(Opts & TEXT_IGNORE_EMPTY_LINES) || newLine.hash != cHashSeed)
+			*out++ = newLine;
+	}
+
+	return static_cast<intptr_t>(out - (doc.lines.data() + startLine));
+}
+
+
+// Hashes both documents' lines at the same time - the sections are split into line chunks that are processed
+// in parallel
+void getLines(DocCmpInfo& doc1, DocCmpInfo& doc2, const CompareOptions& options, CompareProgress* progress)
+{
+	const intptr_t linesPerChunk = 4096;
+
+	struct LinesChunk
+	{
+		DocCmpInfo*	doc;
+		intptr_t	startLine;
+		intptr_t	endLine;
+		intptr_t	linesCount;
+	};
+
+	std::vector<LinesChunk> chunks;
+
+	for (DocCmpInfo* doc: {&doc1, &doc2})
+	{
+		doc->lines.clear();
+
+		const intptr_t linesCount = doc->text->linesCount();
+
+		if (linesCount == 0)
+			continue;
+
+		if ((doc->section.len <= 0) || (doc->section.off + doc->section.len > linesCount))
+			doc->section.len = linesCount - doc->section.off;
+
+		doc->lines.resize(doc->section.len);
+
+		for (intptr_t startLine = 0; startLine < doc->section.len; startLine += linesPerChunk)
+			chunks.push_back({ doc, startLine, std::min(startLine + linesPerChunk, doc->section.len), 0 });
+	}
+
+	if (progress)
+		progress->SetMaxCount(static_cast<intptr_t>(chunks.size()));
+
+	std::atomic<bool> cancelled {false};
+
+#ifdef MULTITHREAD
+	std::mutex mtx;
+#endif
+
+	parallelFor(static_cast<intptr_t>(chunks.size()), getWorkersCount(),
+		[&](intptr_t chunkIdx, int)
+		{
+			if (cancelled)
+				return;
+
+			LinesChunk& chunk = chunks[chunkIdx];
+
+			chunk.linesCount = chunk.doc->extractor->hashLines(*chunk.doc, chunk.startLine, chunk.endLine, options);
+
+			if (progress)
+			{
+#ifdef MULTITHREAD
+				Autolock lock(mtx);
+#endif
+
+				if (!progress->Advance())
+					cancelled = true;
+			}
+		});
+
+	if (cancelled)
+	{
+		doc1.lines.clear();
+		doc2.lines.clear();
+		return;
+	}
+
+	// Chunks are in order - close the gaps left by the skipped empty lines
+	intptr_t storedLines = 0;
+
+	for (const auto& chunk: chunks)
+	{
+		if (chunk.startLine == 0)
+			storedLines = 0;
+
+		if (storedLines != chunk.startLine)
+			std::move(chunk.doc->lines.begin() + chunk.startLine,
+					chunk.doc->lines.begin() + chunk.startLine + chunk.linesCount,
+					chunk.doc->lines.begin() + storedLines);
+
+		storedLines += chunk.linesCount;
+
+		if (chunk.endLine == chunk.doc->section.len)
+			chunk.doc->lines.resize(storedLines);
 	}
 }
 
@@ -506,7 +1082,7 @@ charType getCharTypeW(wchar_t letter)
 	if (letter == L' ' || letter == L'\t')
 		return charType::SPACECHAR;
 
-	if (::IsCharAlphaNumericW(letter) || letter == L'_')
+	if (isCharAlphaNumeric(letter) || letter == L'_')
 		return charType::ALPHANUMCHAR;
 
 	return charType::OTHERCHAR;
@@ -521,32 +1097,23 @@ inline void recalculateWordPos(std::vector<Word>& words, const std::vector<wchar
 	for (auto& word : words)
 	{
 		if (currPos < word.pos)
-			bytePos +=
-				::WideCharToMultiByte(CP_UTF8, 0, line.data() + currPos, word.pos - currPos, NULL, 0, NULL, NULL);
+			bytePos += wideCharToUtf8Len(line.data() + currPos, word.pos - currPos);
 
 		currPos = word.pos + word.len;
-		word.len = ::WideCharToMultiByte(CP_UTF8, 0, line.data() + word.pos, word.len, NULL, 0, NULL, NULL);
+		word.len = wideCharToUtf8Len(line.data() + word.pos, word.len);
 		word.pos = bytePos;
 		bytePos += word.len;
 	}
 }
 
 
-inline void getLineRangeWords(std::vector<Word>& words, std::vector<wchar_t>& line, intptr_t pos, intptr_t endPos,
-		const CompareOptions& options)
+template <unsigned Opts>
+inline void getLineRangeWords(std::vector<Word>& words, std::vector<wchar_t>& line, intptr_t pos, intptr_t endPos)
 {
 	if (pos < endPos)
 	{
-		if (options.ignoreCase)
-		{
-			const wchar_t storedChar = line[endPos];
-
-			line[endPos] = L'\0';
-
-			::CharLowerW((LPWSTR)line.data() + pos);
-
-			line[endPos] = storedChar;
-		}
+		if (Opts & TEXT_IGNORE_CASE)
+			toLowerCase(line.data() + pos, endPos - pos);
 
 		charType currentWordType = getCharTypeW(line[pos]);
 
@@ -566,7 +1133,7 @@ inline void getLineRangeWords(std::vector<Word>& words, std::vector<wchar_t>& li
 			}
 			else
 			{
-				if (!options.ignoreSpaces || currentWordType != charType::SPACECHAR)
+				if (!(Opts & TEXT_IGNORE_SPACES) || currentWordType != charType::SPACECHAR)
 					words.emplace_back(word);
 
 				currentWordType = newWordType;
@@ -577,12 +1144,13 @@ inline void getLineRangeWords(std::vector<Word>& words, std::vector<wchar_t>& li
 			}
 		}
 
-		if (!options.ignoreSpaces || currentWordType != charType::SPACECHAR)
+		if (!(Opts & TEXT_IGNORE_SPACES) || currentWordType != charType::SPACECHAR)
 			words.emplace_back(word);
 	}
 }
 
 
+template <unsigned Opts>
 std::vector<Word> getRegexIgnoreLineWords(std::vector<wchar_t>& line, const CompareOptions& options)
 {
 	std::vector<Word> words;
@@ -599,41 +1167,38 @@ std::vector<Word> getRegexIgnoreLineWords(std::vector<wchar_t>& line, const Comp
 
 	while (rit != rend)
 	{
-		getLineRangeWords(words, line, pos, rit->position(), options);
+		getLineRangeWords<Opts>(words, line, pos, rit->position());
 
 		pos = rit->position() + rit->length();
 		++rit;
 	}
 
-	getLineRangeWords(words, line, pos, len - 1, options);
+	getLineRangeWords<Opts>(words, line, pos, len);
 
 	return words;
 }
 
 
-std::vector<Word> getLineWords(int view, intptr_t docLine, const CompareOptions& options)
+template <unsigned Opts>
+std::vector<Word> getLineWords(const TextSnapshot& text, intptr_t docLine, const CompareOptions& options)
 {
 	std::vector<Word> words;
 
-	const intptr_t lineStart	= getLineStart(view, docLine);
-	const intptr_t lineEnd		= getLineEnd(view, docLine);
+	const intptr_t lineStart	= text.lineStart(docLine);
+	const intptr_t lineEnd		= text.lineEnd(docLine);
 
 	if (lineStart < lineEnd)
 	{
-		std::vector<char> line = getText(view, lineStart, lineEnd);
-
-		const intptr_t len = static_cast<intptr_t>(line.size());
+		const intptr_t len = lineEnd - lineStart;
 
-		const int wLen = ::MultiByteToWideChar(CP_UTF8, 0, line.data(), len, NULL, 0);
+		std::vector<wchar_t> wLine = toWideChar(text.data() + lineStart, len);
 
-		std::vector<wchar_t> wLine(wLen);
+		const intptr_t wLen = static_cast<intptr_t>(wLine.size());
 
-		::MultiByteToWideChar(CP_UTF8, 0, line.data(), len, wLine.data(), wLen);
-
-		if (options.ignoreRegex)
-			words = getRegexIgnoreLineWords(wLine, options);
+		if (Opts & TEXT_IGNORE_REGEX)
+			words = getRegexIgnoreLineWords<Opts>(wLine, options);
 		else
-			getLineRangeWords(words, wLine, 0, wLen - 1, options);
+			getLineRangeWords<Opts>(words, wLine, 0, wLen);
 
 		// In case of UTF-16 or UTF-32 find words byte positions and lengths because Scintilla uses those
 		if (wLen != len)
@@ -652,61 +1217,50 @@ inline void recalculateCharPos(std::vector<Char>& chars, const std::vector<wchar
 	for (auto& ch : chars)
 	{
 		if (currPos < ch.pos)
-			bytePos +=
-				::WideCharToMultiByte(CP_UTF8, 0, sec.data() + currPos, ch.pos - currPos, NULL, 0, NULL, NULL);
+			bytePos += wideCharToUtf8Len(sec.data() + currPos, ch.pos - currPos);
 
 		currPos = ch.pos + 1;
-		const int charLen = ::WideCharToMultiByte(CP_UTF8, 0, sec.data() + ch.pos, 1, NULL, 0, NULL, NULL);
+		const intptr_t charLen = wideCharToUtf8Len(sec.data() + ch.pos, 1);
 		ch.pos = bytePos;
 		bytePos += charLen;
 	}
 }
 
 
-void getSectionRangeChars(std::vector<Char>& chars, std::vector<wchar_t>& sec, intptr_t pos, intptr_t endPos,
-		const CompareOptions& options)
+template <unsigned Opts>
+void getSectionRangeChars(std::vector<Char>& chars, std::vector<wchar_t>& sec, intptr_t pos, intptr_t endPos)
 {
 	if (pos < endPos)
 	{
-		if (options.ignoreCase)
-		{
-			const wchar_t storedChar = sec[endPos];
-
-			sec[endPos] = L'\0';
-
-			::CharLowerW((LPWSTR)sec.data() + pos);
-
-			sec[endPos] = storedChar;
-		}
+		if (Opts & TEXT_IGNORE_CASE)
+			toLowerCase(sec.data() + pos, endPos - pos);
 
 		for (; pos < endPos; ++pos)
 		{
-			if (!options.ignoreSpaces || getCharTypeW(sec[pos]) != charType::SPACECHAR)
+			if (!(Opts & TEXT_IGNORE_SPACES) || getCharTypeW(sec[pos]) != charType::SPACECHAR)
 				chars.emplace_back(sec[pos], pos);
 		}
 	}
 }
 
 
-std::vector<Char> getSectionChars(int view, intptr_t secStart, intptr_t secEnd, const CompareOptions& options)
+template <unsigned Opts>
+std::vector<Char> getSectionChars(const TextSnapshot& text, intptr_t secStart, intptr_t secEnd,
+		const CompareOptions&)
 {
 	std::vector<Char> chars;
 
 	if (secStart < secEnd)
 	{
-		std::vector<char> sec = getText(view, secStart, secEnd);
-
-		const intptr_t len = static_cast<intptr_t>(sec.size());
+		const intptr_t len = secEnd - secStart;
 
-		const int wLen = ::MultiByteToWideChar(CP_UTF8, 0, sec.data(), len, NULL, 0);
+		std::vector<wchar_t> wSec = toWideChar(text.data() + secStart, len);
 
-		std::vector<wchar_t> wSec(wLen);
+		const intptr_t wLen = static_cast<intptr_t>(wSec.size());
 
-		::MultiByteToWideChar(CP_UTF8, 0, sec.data(), len, wSec.data(), wLen);
+		chars.reserve(wLen);
 
-		chars.reserve(wLen - 1);
-
-		getSectionRangeChars(chars, wSec, 0, wLen - 1, options);
+		getSectionRangeChars<Opts>(chars, wSec, 0, wLen);
 
 		// In case of UTF-16 or UTF-32 find chars byte positions because Scintilla uses those
 		if (wLen != len)
@@ -717,23 +1271,21 @@ std::vector<Char> getSectionChars(int view, intptr_t secStart, intptr_t secEnd,
 }
 
 
-std::vector<Char> getRegexIgnoreChars(int view, intptr_t secStart, intptr_t secEnd, const CompareOptions& options)
+template <unsigned Opts>
+std::vector<Char> getRegexIgnoreChars(const TextSnapshot& text, intptr_t secStart, intptr_t secEnd,
+		const CompareOptions& options)
 {
 	std::vector<Char> chars;
 
 	if (secStart < secEnd)
 	{
-		std::vector<char> sec = getText(view, secStart, secEnd);
-
-		const intptr_t len = static_cast<intptr_t>(sec.size());
+		const intptr_t len = secEnd - secStart;
 
-		const int wLen = ::MultiByteToWideChar(CP_UTF8, 0, sec.data(), len, NULL, 0);
+		std::vector<wchar_t> wSec = toWideChar(text.data() + secStart, len);
 
-		std::vector<wchar_t> wSec(wLen);
+		const intptr_t wLen = static_cast<intptr_t>(wSec.size());
 
-		::MultiByteToWideChar(CP_UTF8, 0, sec.data(), len, wSec.data(), wLen);
-
-		chars.reserve(wLen - 1);
+		chars.reserve(wLen);
 
 		std::regex_iterator<std::vector<wchar_t>::iterator> rit(wSec.begin(), wSec.end(), *options.ignoreRegex);
 		std::regex_iterator<std::vector<wchar_t>::iterator> rend;
@@ -742,13 +1294,13 @@ std::vector<Char> getRegexIgnoreChars(int view, intptr_t secStart, intptr_t secE
 
 		while (rit != rend)
 		{
-			getSectionRangeChars(chars, wSec, pos, rit->position(), options);
+			getSectionRangeChars<Opts>(chars, wSec, pos, rit->position());
 
 			pos = rit->position() + rit->length();
 			++rit;
 		}
 
-		getSectionRangeChars(chars, wSec, pos, wLen - 1, options);
+		getSectionRangeChars<Opts>(chars, wSec, pos, wLen);
 
 		// In case of UTF-16 or UTF-32 find chars byte positions because Scintilla uses those
 		if (wLen != len)
@@ -759,6 +1311,53 @@ std::vector<Char> getRegexIgnoreChars(int view, intptr_t secStart, intptr_t secE
 }
 
 
+template <unsigned Opts>
+TextExtractor makeTextExtractor()
+{
+	// Keep only the options each function depends on to limit the instantiations
+	const unsigned cSpacesCase = Opts & (TEXT_IGNORE_SPACES | TEXT_IGNORE_CASE);
+	const unsigned cWordsChars = Opts & ~TEXT_IGNORE_EMPTY_LINES;
+
+	TextExtractor extractor;
+
+	extractor.hashLines			= &hashLines<Opts>;
+	extractor.getLineWords		= &getLineWords<cWordsChars>;
+	extractor.getSectionChars	= &getSectionChars<cSpacesCase>;
+
+	if (Opts & TEXT_IGNORE_REGEX)
+		extractor.getLineChars	= &getRegexIgnoreChars<cSpacesCase>;
+	else
+		extractor.getLineChars	= &getSectionChars<cSpacesCase>;
+
+	return extractor;
+}
+
+
+// Picks the text extraction instantiation matching the compare options - done once per compare
+const TextExtractor* selectTextExtractor(const CompareOptions& options)
+{
+	static const TextExtractor cExtractors[TEXT_OPTIONS_COMBINATIONS] = {
+		makeTextExtractor<0x0>(), makeTextExtractor<0x1>(), makeTextExtractor<0x2>(), makeTextExtractor<0x3>(),
+		makeTextExtractor<0x4>(), makeTextExtractor<0x5>(), makeTextExtractor<0x6>(), makeTextExtractor<0x7>(),
+		makeTextExtractor<0x8>(), makeTextExtractor<0x9>(), makeTextExtractor<0xA>(), makeTextExtractor<0xB>(),
+		makeTextExtractor<0xC>(), makeTextExtractor<0xD>(), makeTextExtractor<0xE>(), makeTextExtractor<0xF>()
+	};
+
+	unsigned opts = 0;
+
+	if (options.ignoreSpaces)
+		opts |= TEXT_IGNORE_SPACES;
+	if (options.ignoreCase)
+		opts |= TEXT_IGNORE_CASE;
+	if (options.ignoreEmptyLines)
+		opts |= TEXT_IGNORE_EMPTY_LINES;
+	if (options.ignoreRegex)
+		opts |= TEXT_IGNORE_REGEX;
+
+	return &cExtractors[opts];
+}
+
+
 std::vector<std::vector<Char>> getChars(const DocCmpInfo& doc, const diffInfo& blockDiff,
 		const CompareOptions& options)
 {
@@ -774,16 +1373,11 @@ std::vector<std::vector<Char>> getChars(const DocCmpInfo& doc, const diffInfo& b
 		}
 
 		const intptr_t docLine		= doc.lines[blockLine + blockDiff.off].line;
-		const intptr_t lineStart	= getLineStart(doc.view, docLine);
-		const intptr_t lineEnd		= getLineEnd(doc.view, docLine);
+		const intptr_t lineStart	= doc.text->lineStart(docLine);
+		const intptr_t lineEnd		= doc.text->lineEnd(docLine);
 
 		if (lineStart < lineEnd)
-		{
-			if (options.ignoreRegex)
-				chars[blockLine] = getRegexIgnoreChars(doc.view, lineStart, lineEnd, options);
-			else
-				chars[blockLine] = getSectionChars(doc.view, lineStart, lineEnd, options);
-		}
+			chars[blockLine] = doc.extractor->getLineChars(*doc.text, lineStart, lineEnd, options);
 	}
 
 	return chars;
@@ -796,20 +1390,20 @@ void findBestMatch(const CompareInfo& cmpInfo, const diffInfo& lookupDiff, intpt
 	mi.matchLen		= 0;
 	mi.matchDiff	= nullptr;
 
-	const std::vector<Line>* pLookupLines;
-	const std::vector<Line>* pMatchLines;
+	const std::vector<uint32_t>* pLookupLines;
+	const std::vector<uint32_t>* pMatchLines;
 	diff_type matchType;
 
 	if (lookupDiff.type == diff_type::DIFF_IN_1)
 	{
-		pLookupLines	= &cmpInfo.doc1.lines;
-		pMatchLines		= &cmpInfo.doc2.lines;
+		pLookupLines	= &cmpInfo.doc1.lineIds;
+		pMatchLines		= &cmpInfo.doc2.lineIds;
 		matchType		= diff_type::DIFF_IN_2;
 	}
 	else
 	{
-		pLookupLines	= &cmpInfo.doc2.lines;
-		pMatchLines		= &cmpInfo.doc1.lines;
+		pLookupLines	= &cmpInfo.doc2.lineIds;
+		pMatchLines		= &cmpInfo.doc1.lineIds;
 		matchType		= diff_type::DIFF_IN_1;
 	}
 
@@ -953,31 +1547,51 @@ void findMoves(CompareInfo& cmpInfo)
 }
 
 
-void findUniqueLines(CompareInfo& cmpInfo)
+// Interns the lines' hashes of both docs into dense equivalence class IDs (as GNU diff does) - the lines are then
+// compared as 32-bit IDs instead of Line structs. Returns the classes count
+uint32_t internLines(DocCmpInfo& doc1, DocCmpInfo& doc2)
 {
-	std::unordered_map<uint64_t, std::vector<intptr_t>> doc1LinesMap;
+	std::unordered_map<uint64_t, uint32_t> classes;
 
-	for (const auto& line: cmpInfo.doc1.lines)
+	classes.reserve(doc1.lines.size() + doc2.lines.size());
+
+	for (DocCmpInfo* doc: {&doc1, &doc2})
 	{
-		auto insertPair = doc1LinesMap.emplace(line.hash, std::vector<intptr_t>{line.line});
-		if (!insertPair.second)
-			insertPair.first->second.emplace_back(line.line);
+		const intptr_t linesCount = static_cast<intptr_t>(doc->lines.size());
+
+		doc->lineIds.resize(linesCount);
+
+		for (intptr_t i = 0; i < linesCount; ++i)
+		{
+			const uint32_t newId = static_cast<uint32_t>(classes.size());
+
+			doc->lineIds[i] = classes.emplace(doc->lines[i].hash, newId).first->second;
+		}
 	}
 
-	for (const auto& line: cmpInfo.doc2.lines)
+	return static_cast<uint32_t>(classes.size());
+}
+
+
+void findUniqueLines(CompareInfo& cmpInfo, uint32_t classesCount)
+{
+	// Bit 0 set if the class is present in doc1, bit 1 - in doc2
+	std::vector<uint8_t> classDocs(classesCount, 0);
+
+	for (uint32_t id: cmpInfo.doc1.lineIds)
+		classDocs[id] |= 1;
+
+	for (uint32_t id: cmpInfo.doc2.lineIds)
+		classDocs[id] |= 2;
+
+	for (DocCmpInfo* doc: {&cmpInfo.doc1, &cmpInfo.doc2})
 	{
-		auto doc1it = doc1LinesMap.find(line.hash);
+		const intptr_t linesCount = static_cast<intptr_t>(doc->lines.size());
 
-		if (doc1it != doc1LinesMap.end())
+		for (intptr_t i = 0; i < linesCount; ++i)
 		{
-			cmpInfo.doc2.nonUniqueLines.emplace(line.line);
-
-			auto insertPair = cmpInfo.doc1.nonUniqueLines.emplace(doc1it->second[0]);
-			if (insertPair.second)
-			{
-				for (size_t j = 1; j < doc1it->second.size(); ++j)
-					cmpInfo.doc1.nonUniqueLines.emplace(doc1it->second[j]);
-			}
+			if (classDocs[doc->lineIds[i]] == 3)
+				doc->nonUniqueLines.emplace(doc->lines[i].line);
 		}
 	}
 }
@@ -1045,8 +1659,10 @@ void compareLines(const DocCmpInfo& doc1, const DocCmpInfo& doc2, diffInfo& bloc
 		LOGD(LOG_ALGO, "Compare Lines " + std::to_string(doc1.lines[blockDiff1.off + line1].line + 1) + " and " +
 				std::to_string(doc2.lines[blockDiff2.off + line2].line + 1) + "\n");
 
-		const std::vector<Word> lineWords1 = getLineWords(doc1.view, doc1.lines[blockDiff1.off + line1].line, options);
-		const std::vector<Word> lineWords2 = getLineWords(doc2.view, doc2.lines[blockDiff2.off + line2].line, options);
+		const std::vector<Word> lineWords1 =
+				doc1.extractor->getLineWords(*doc1.text, doc1.lines[blockDiff1.off + line1].line, options);
+		const std::vector<Word> lineWords2 =
+				doc2.extractor->getLineWords(*doc2.text, doc2.lines[blockDiff2.off + line2].line, options);
 
 		const auto* pLine1 = &lineWords1;
 		const auto* pLine2 = &lineWords2;
@@ -1076,8 +1692,8 @@ void compareLines(const DocCmpInfo& doc1, const DocCmpInfo& doc2, diffInfo& bloc
 		pBlockDiff1->info.changedLines.emplace_back(line1);
 		pBlockDiff2->info.changedLines.emplace_back(line2);
 
-		const intptr_t lineOff1 = getLineStart(pDoc1->view, pDoc1->lines[line1 + pBlockDiff1->off].line);
-		const intptr_t lineOff2 = getLineStart(pDoc2->view, pDoc2->lines[line2 + pBlockDiff2->off].line);
+		const intptr_t lineOff1 = pDoc1->text->lineStart(pDoc1->lines[line1 + pBlockDiff1->off].line);
+		const intptr_t lineOff2 = pDoc2->text->lineStart(pDoc2->lines[line2 + pBlockDiff2->off].line);
 
 		intptr_t lineLen1 = 0;
 		intptr_t lineLen2 = 0;
@@ -1122,9 +1738,11 @@ void compareLines(const DocCmpInfo& doc1, const DocCmpInfo& doc2, diffInfo& bloc
 					intptr_t end2 = (*pLine2)[ld2.off + ld2.len - 1].pos + (*pLine2)[ld2.off + ld2.len - 1].len;
 
 					const std::vector<Char> sec1 =
-							getSectionChars(pDoc1->view, off1 + lineOff1, end1 + lineOff1, options);
+							pDoc1->extractor->getSectionChars(*pDoc1->text, off1 + lineOff1, end1 + lineOff1,
+									options);
 					const std::vector<Char> sec2 =
-							getSectionChars(pDoc2->view, off2 + lineOff2, end2 + lineOff2, options);
+							pDoc2->extractor->getSectionChars(*pDoc2->text, off2 + lineOff2, end2 + lineOff2,
+									options);
 
 					if (options.detectCharDiffs)
 					{
@@ -1141,7 +1759,7 @@ void compareLines(const DocCmpInfo& doc1, const DocCmpInfo& doc2, diffInfo& bloc
 						diffInfo* pBD2 = pBlockDiff2;
 
 						// Compare changed words
-						auto diffRes = DiffCalc<Char>(sec1, sec2)();
+						auto diffRes = diffChars(sec1, sec2, options);
 						const std::vector<diff_info<void>> sectionDiffs = std::move(diffRes.first);
 
 						if (diffRes.second)
@@ -1220,53 +1838,252 @@ void compareLines(const DocCmpInfo& doc1, const DocCmpInfo& doc2, diffInfo& bloc
 								}
 							}
 
-							// No matching sections between the lines found - move to next lines
-							if (lineDiffsSize == 2)
-								break;
-						}
-					}
-					// Always match non-alphabetical characters in the beginning and at the end
-					else
-					{
-						const intptr_t matches =
-								matchBeginEnd(*pBlockDiff1, *pBlockDiff2, sec1, sec2, off1, off2, end1, end2,
-										[](wchar_t ch) { return (getCharTypeW(ch) != charType::ALPHANUMCHAR); });
+							// No matching sections between the lines found - move to next lines
+							if (lineDiffsSize == 2)
+								break;
+						}
+					}
+					// Always match non-alphabetical characters in the beginning and at the end
+					else
+					{
+						const intptr_t matches =
+								matchBeginEnd(*pBlockDiff1, *pBlockDiff2, sec1, sec2, off1, off2, end1, end2,
+										[](wchar_t ch) { return (getCharTypeW(ch) != charType::ALPHANUMCHAR); });
+
+						if (matches)
+						{
+							totalLineMatchLen += matches;
+
+							++i;
+							continue;
+						}
+
+						// No matching sections between the lines found - move to next lines
+						if (lineDiffsSize == 2)
+							break;
+					}
+				}
+
+				section_t change;
+
+				change.off = (*pLine1)[ld.off].pos;
+				change.len = (*pLine1)[ld.off + ld.len - 1].pos + (*pLine1)[ld.off + ld.len - 1].len - change.off;
+
+				pBlockDiff1->info.changedLines.back().changes.emplace_back(change);
+			}
+		}
+
+		// Not enough portion of the lines matches - consider them totally different
+		if (((totalLineMatchLen * 100) / std::max(lineLen1, lineLen2)) < options.changedThresholdPercent)
+		{
+			pBlockDiff1->info.changedLines.pop_back();
+			pBlockDiff2->info.changedLines.pop_back();
+		}
+	}
+}
+
+
+/**
+ *  \class  WordsLens
+ *  \brief  Line's words span and their lengths prefix sums in ascending length order
+ */
+struct WordsLens
+{
+	WordsLens() = default;
+	WordsLens(const std::vector<Word>& words);
+
+	// The most words that can be left unmatched with the matched words span still at least minMatches (-1 if none)
+	inline intptr_t maxUnmatched(intptr_t minMatches) const;
+
+	intptr_t span {0};
+	std::vector<intptr_t> sums;
+};
+
+
+WordsLens::WordsLens(const std::vector<Word>& words) : sums(words.size() + 1, 0)
+{
+	if (words.empty())
+		return;
+
+	span = words.back().pos + words.back().len - words.front().pos;
+
+	for (size_t i = 0; i < words.size(); ++i)
+		sums[i + 1] = words[i].len;
+
+	std::sort(sums.begin() + 1, sums.end());
+
+	for (size_t i = 1; i < sums.size(); ++i)
+		sums[i] += sums[i - 1];
+}
+
+
+inline intptr_t WordsLens::maxUnmatched(intptr_t minMatches) const
+{
+	return static_cast<intptr_t>(std::upper_bound(sums.begin(), sums.end(), span - minMatches) - sums.begin()) - 1;
+}
+
+
+// DiffCalc's max for a diff of size1 and size2 elements that can have edit distance up to maxDistance (0 if the sizes
+// difference alone is bigger)
+inline intptr_t diffDistanceLimit(intptr_t size1, intptr_t size2, intptr_t maxDistance)
+{
+	return (maxDistance < std::abs(size1 - size2)) ? 0 : maxDistance + 1;
+}
+
+
+// The biggest edit distance of the lines words diff that can still give minMatches matched words span. The matches
+// are counted in the words of one of the lines and each of its unmatched words takes its length off the span
+inline intptr_t wordsDiffMaxDistance(const WordsLens& lens1, const WordsLens& lens2, intptr_t minMatches)
+{
+	const intptr_t wordsCount1 = static_cast<intptr_t>(lens1.sums.size()) - 1;
+	const intptr_t wordsCount2 = static_cast<intptr_t>(lens2.sums.size()) - 1;
+
+	const intptr_t maxUnmatched1 = lens1.maxUnmatched(minMatches);
+	const intptr_t maxUnmatched2 = lens2.maxUnmatched(minMatches);
+
+	// The edit distance is the unmatched words count of both lines
+	const intptr_t maxDistance1 = (maxUnmatched1 < 0) ? -1 : 2 * maxUnmatched1 + wordsCount2 - wordsCount1;
+	const intptr_t maxDistance2 = (maxUnmatched2 < 0) ? -1 : 2 * maxUnmatched2 + wordsCount1 - wordsCount2;
+
+	return std::max(maxDistance1, maxDistance2);
+}
+
+
+/**
+ *  \class  LinesSketchIndex
+ *  \brief  MinHash sketches of lines' chars 3-grams, banded into LSH (locality-sensitive hashing) buckets. Lines
+ *          sharing a bucket with a line are its likely similar ones - only they are diffed when a changed block is
+ *          too big to diff all its lines pairs
+ */
+class LinesSketchIndex
+{
+public:
+	// The least lines pairs count of a changed block to prune with the index
+	static const intptr_t cMinPrunedPairs = 4000000;
+
+	LinesSketchIndex(const std::vector<std::vector<Char>>& lines);
+
+	// Gets the indexed lines similar to chars in ascending order. Returns false if chars are too short to sketch -
+	// all lines are candidates then
+	bool getCandidates(const std::vector<Char>& chars, std::vector<intptr_t>& candidates) const;
+
+private:
+	static const intptr_t cGramLen	= 3;
+	static const int cBands			= 32;
+	static const int cBandRows		= 2;
+	static const int cHashes		= cBands * cBandRows;
+
+	static inline uint64_t mix(uint64_t h);
+
+	static void sketch(const std::vector<Char>& chars, uint64_t (&mins)[cHashes]);
+	static inline uint64_t bandKey(const uint64_t (&mins)[cHashes], int band);
+
+	std::unordered_map<uint64_t, std::vector<intptr_t>> _buckets;
+
+	// Lines too short to sketch - candidates of all lines
+	std::vector<intptr_t> _shortLines;
+};
+
+
+LinesSketchIndex::LinesSketchIndex(const std::vector<std::vector<Char>>& lines)
+{
+	uint64_t mins[cHashes];
+
+	for (intptr_t line = 0; line < static_cast<intptr_t>(lines.size()); ++line)
+	{
+		if (lines[line].empty())
+			continue;
+
+		if (static_cast<intptr_t>(lines[line].size()) < cGramLen)
+		{
+			_shortLines.emplace_back(line);
+			continue;
+		}
+
+		sketch(lines[line], mins);
+
+		for (int band = 0; band < cBands; ++band)
+			_buckets[bandKey(mins, band)].emplace_back(line);
+	}
+}
+
+
+bool LinesSketchIndex::getCandidates(const std::vector<Char>& chars, std::vector<intptr_t>& candidates) const
+{
+	candidates.clear();
+
+	if (static_cast<intptr_t>(chars.size()) < cGramLen)
+		return false;
+
+	uint64_t mins[cHashes];
+
+	sketch(chars, mins);
+
+	for (int band = 0; band < cBands; ++band)
+	{
+		const auto bucket = _buckets.find(bandKey(mins, band));
+
+		if (bucket != _buckets.end())
+			candidates.insert(candidates.end(), bucket->second.begin(), bucket->second.end());
+	}
+
+	candidates.insert(candidates.end(), _shortLines.begin(), _shortLines.end());
+
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+	return true;
+}
+
 
-						if (matches)
-						{
-							totalLineMatchLen += matches;
+// SplitMix64 finalizer
+inline uint64_t LinesSketchIndex::mix(uint64_t h)
+{
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
 
-							++i;
-							continue;
-						}
+	return h ^ (h >> 31);
+}
 
-						// No matching sections between the lines found - move to next lines
-						if (lineDiffsSize == 2)
-							break;
-					}
-				}
 
-				section_t change;
+void LinesSketchIndex::sketch(const std::vector<Char>& chars, uint64_t (&mins)[cHashes])
+{
+	std::fill(std::begin(mins), std::end(mins), UINT64_MAX);
 
-				change.off = (*pLine1)[ld.off].pos;
-				change.len = (*pLine1)[ld.off + ld.len - 1].pos + (*pLine1)[ld.off + ld.len - 1].len - change.off;
+	const intptr_t gramsCount = static_cast<intptr_t>(chars.size()) - cGramLen + 1;
 
-				pBlockDiff1->info.changedLines.back().changes.emplace_back(change);
-			}
-		}
+	for (intptr_t i = 0; i < gramsCount; ++i)
+	{
+		const uint64_t gram = mix((static_cast<uint64_t>(chars[i].ch) << 42) ^
+				(static_cast<uint64_t>(chars[i + 1].ch) << 21) ^ static_cast<uint64_t>(chars[i + 2].ch));
 
-		// Not enough portion of the lines matches - consider them totally different
-		if (((totalLineMatchLen * 100) / std::max(lineLen1, lineLen2)) < options.changedThresholdPercent)
+		for (int k = 0; k < cHashes; ++k)
 		{
-			pBlockDiff1->info.changedLines.pop_back();
-			pBlockDiff2->info.changedLines.pop_back();
+			const uint64_t h = mix(gram + (k + 1) * 0x9E3779B97F4A7C15ULL);
+
+			if (mins[k] > h)
+				mins[k] = h;
 		}
 	}
 }
 
 
+inline uint64_t LinesSketchIndex::bandKey(const uint64_t (&mins)[cHashes], int band)
+{
+	uint64_t key = band;
+
+	for (int row = 0; row < cBandRows; ++row)
+		key = mix(key ^ mins[band * cBandRows + row]);
+
+	return key;
+}
+
+
+// progress is advanced concurrently (see SharedProgress). approximate is set if the sketch index has skipped line
+// pairs that would have been diffed
 std::vector<std::set<LinesConv>> getOrderedConvergence(const DocCmpInfo& doc1, const DocCmpInfo& doc2,
-		const diffInfo& blockDiff1, const diffInfo& blockDiff2, const CompareOptions& options)
+		const diffInfo& blockDiff1, const diffInfo& blockDiff2, const CompareOptions& options,
+		CompareProgress* progress, bool& approximate)
 {
 	const std::vector<std::vector<Char>> chunk1 = getChars(doc1, blockDiff1, options);
 	const std::vector<std::vector<Char>> chunk2 = getChars(doc2, blockDiff2, options);
@@ -1275,283 +2092,302 @@ std::vector<std::set<LinesConv>> getOrderedConvergence(const DocCmpInfo& doc1, c
 	const intptr_t linesCount2 = static_cast<intptr_t>(chunk2.size());
 
 	std::vector<std::vector<Word>> words2(linesCount2);
+	std::vector<WordsLens> words2Lens(linesCount2);
 
 	if (!options.detectCharDiffs)
 	{
 		for (intptr_t line2 = 0; line2 < linesCount2; ++line2)
+		{
 			if (!chunk2[line2].empty())
-				words2[line2] = getLineWords(doc2.view, doc2.lines[blockDiff2.off + line2].line, options);
+			{
+				words2[line2] =
+						doc2.extractor->getLineWords(*doc2.text, doc2.lines[blockDiff2.off + line2].line, options);
+				words2Lens[line2] = WordsLens(words2[line2]);
+			}
+		}
 	}
 
 	std::vector<std::set<LinesConv>> lines1Convergence(linesCount1);
 	std::vector<std::set<LinesConv>> lines2Convergence(linesCount2);
 
-#ifdef MULTITHREAD
-	std::mutex mtx;
-#endif
-
-	auto workFn =
-		[&](intptr_t startLine, intptr_t endLine)
+	// Keeps the best line2 matches of each line1 and the best line1 matches of each line2
+	auto addConvergence =
+		[&](const LinesConv& lc)
 		{
-			progress_ptr& progress = ProgressDlg::Get();
+			const Conv& conv		= lc.conv;
+			const intptr_t line1	= lc.line1;
+			const intptr_t line2	= lc.line2;
 
-			intptr_t linesProgress = 0;
+			bool addL1C = false;
 
-			for (intptr_t line1 = startLine; line1 < endLine; ++line1)
+			if (lines2Convergence[line2].empty() || (conv == lines2Convergence[line2].begin()->conv))
+			{
+				lines2Convergence[line2].emplace(conv, line1, line2);
+				addL1C = true;
+			}
+			else if (conv > lines2Convergence[line2].begin()->conv)
 			{
-				if (chunk1[line1].empty())
+				for (const auto& l2c : lines2Convergence[line2])
 				{
-					linesProgress += linesCount2;
-					continue;
+					auto& l1c = lines1Convergence[l2c.line1];
+
+					if (!l1c.empty())
+					{
+						for (auto l1cI = l1c.begin(); l1cI != l1c.end(); ++l1cI)
+						{
+							if (l1cI->line2 == line2)
+							{
+								l1c.erase(l1cI);
+								break;
+							}
+						}
+					}
 				}
 
-				std::vector<Word> words1;
+				lines2Convergence[line2].clear();
+				lines2Convergence[line2].emplace(conv, line1, line2);
+				addL1C = true;
+			}
 
-				for (intptr_t line2 = 0; line2 < linesCount2; ++line2)
+			if (addL1C)
+			{
+				if (lines1Convergence[line1].empty() || (conv == lines1Convergence[line1].begin()->conv))
 				{
-					if (chunk2[line2].empty())
-					{
-						++linesProgress;
-						continue;
-					}
+					lines1Convergence[line1].emplace(conv, line1, line2);
+				}
+				else if (conv > lines1Convergence[line1].begin()->conv)
+				{
+					lines1Convergence[line1].clear();
+					lines1Convergence[line1].emplace(conv, line1, line2);
+				}
+			}
+		};
 
-					const intptr_t minSize = std::min(chunk1[line1].size(), chunk2[line2].size());
-					const intptr_t maxSize = std::max(chunk1[line1].size(), chunk2[line2].size());
+	// Diffing all lines pairs of a huge block takes too long - only the likely similar ones are diffed then
+	std::unique_ptr<LinesSketchIndex> sketchIndex;
 
-					if (((minSize * 100) / maxSize) < options.changedThresholdPercent)
-					{
-						++linesProgress;
-						continue;
-					}
+	if (linesCount1 * linesCount2 >= LinesSketchIndex::cMinPrunedPairs)
+		sketchIndex = std::make_unique<LinesSketchIndex>(chunk2);
 
-					intptr_t matchesCount	= 0;
-					intptr_t diffsCount		= 0;
+	std::atomic<bool> cancelled {false};
+	std::atomic<bool> pairsSkipped {false};
 
-					if (!options.detectCharDiffs)
-					{
-						if (words1.empty())
-							words1 = getLineWords(doc1.view, doc1.lines[blockDiff1.off + line1].line, options);
+	auto reportProgress =
+		[&](intptr_t linesProgress)
+		{
+			if (progress && (linesProgress > 0) && !progress->Advance(linesProgress))
+				cancelled.store(true, std::memory_order_relaxed);
+		};
 
-						auto wordDiffs = DiffCalc<Word>(words1, words2[line2])(true);
+	// Each job diffs a line1 with all line2 lines and logs the matching pairs without locking. Each thread keeps its
+	// best line1 match of each line2 to log less. The logs are added to the lines tables in line1 order after all
+	// jobs finish so the result is the same as a single thread's
+	const int threadsCount = getWorkersCount();
 
-						const std::vector<Word>& rWord = wordDiffs.second ? words2[line2] : words1;
+	std::vector<std::vector<LinesConv>> threadsLines2Best(threadsCount);
+	std::vector<std::vector<intptr_t>> threadsCandidates(threadsCount);
 
-						const intptr_t wordDiffsSize = static_cast<intptr_t>(wordDiffs.first.size());
+	std::vector<std::vector<LinesConv>> linesAccepted(linesCount1);
 
-						for (intptr_t i = 0; i < wordDiffsSize; ++i)
-						{
-							if (wordDiffs.first[i].type == diff_type::DIFF_MATCH)
-							{
-								matchesCount += (
-										rWord[wordDiffs.first[i].off + wordDiffs.first[i].len - 1].pos +
-										rWord[wordDiffs.first[i].off + wordDiffs.first[i].len - 1].len -
-										rWord[wordDiffs.first[i].off].pos);
-							}
-							else
-							{
-								if (options.bestSeqChangedLines)
-									++diffsCount;
+	parallelFor(linesCount1, threadsCount,
+		[&](intptr_t line1, int slot)
+		{
+			if (cancelled.load(std::memory_order_relaxed))
+				return;
 
-								// Count replacement as a single diff
-								if ((i + 1 < wordDiffsSize) && (wordDiffs.first[i + 1].type == diff_type::DIFF_IN_2))
-									++i;
-							}
-						}
+			if (chunk1[line1].empty())
+			{
+				reportProgress(linesCount2);
+				return;
+			}
 
-						if (matchesCount == 0)
-						{
-							++linesProgress;
-							continue;
-						}
-					}
-					else
-					{
-						auto charDiffs = DiffCalc<Char>(chunk1[line1], chunk2[line2])();
+			std::vector<LinesConv>& lines2Best = threadsLines2Best[slot];
 
-						for (const auto& ld: charDiffs.first)
-						{
-							if (ld.type == diff_type::DIFF_MATCH)
-								matchesCount += ld.len;
-						}
-					}
+			if (lines2Best.empty())
+				lines2Best.resize(linesCount2);
 
-					if (((matchesCount * 100) / minSize) >= options.changedThresholdPercent)
-					{
-						const float lineConvergence = ((static_cast<float>(matchesCount) * 100) / minSize) +
-								((static_cast<float>(matchesCount) * 100) / maxSize);
+			std::vector<intptr_t>& candidates = threadsCandidates[slot];
+			std::vector<LinesConv>& accepted = linesAccepted[line1];
 
-						Conv conv(lineConvergence, diffsCount);
+			intptr_t linesProgress = 0;
 
-#ifdef MULTITHREAD
-						Autolock lock(mtx);
-#endif
+			std::vector<Word> words1;
+			WordsLens words1Lens;
 
-						if (progress && !progress->Advance(linesProgress + 1))
-							return;
+			// The chars matches count of a short line is its LCS length - no need to diff the chars
+			const bool useCharsLcs = options.detectCharDiffs &&
+					(static_cast<intptr_t>(chunk1[line1].size()) <= CharsLcs::cMaxSize);
 
-						linesProgress = 0;
+			const CharsLcs charsLcs1(useCharsLcs ? chunk1[line1] : std::vector<Char>());
 
-						bool addL1C = false;
+			const bool pruned = sketchIndex && sketchIndex->getCandidates(chunk1[line1], candidates);
+			const intptr_t candidatesCount = pruned ? static_cast<intptr_t>(candidates.size()) : linesCount2;
 
-						if (lines2Convergence[line2].empty() || (conv == lines2Convergence[line2].begin()->conv))
-						{
-							lines2Convergence[line2].emplace(conv, line1, line2);
-							addL1C = true;
-						}
-						else if (conv > lines2Convergence[line2].begin()->conv)
-						{
-							for (const auto& l2c : lines2Convergence[line2])
-							{
-								auto& l1c = lines1Convergence[l2c.line1];
+			if (pruned)
+			{
+				linesProgress += linesCount2 - candidatesCount;
 
-								if (!l1c.empty())
-								{
-									for (auto l1cI = l1c.begin(); l1cI != l1c.end(); ++l1cI)
-									{
-										if (l1cI->line2 == line2)
-										{
-											l1c.erase(l1cI);
-											break;
-										}
-									}
-								}
-							}
+				// Is a non-candidate line2 one that would have been diffed (the candidates are in ascending order)?
+				if (!pairsSkipped.load(std::memory_order_relaxed))
+				{
+					intptr_t candidate = 0;
 
-							lines2Convergence[line2].clear();
-							lines2Convergence[line2].emplace(conv, line1, line2);
-							addL1C = true;
+					for (intptr_t line2 = 0; line2 < linesCount2; ++line2)
+					{
+						if (candidate < candidatesCount && candidates[candidate] == line2)
+						{
+							++candidate;
+							continue;
 						}
 
-						if (addL1C)
+						const intptr_t minSize = std::min(chunk1[line1].size(), chunk2[line2].size());
+						const intptr_t maxSize = std::max(chunk1[line1].size(), chunk2[line2].size());
+
+						if (minSize && ((minSize * 100) / maxSize) >= options.changedThresholdPercent)
 						{
-							if (lines1Convergence[line1].empty() || (conv == lines1Convergence[line1].begin()->conv))
-							{
-								lines1Convergence[line1].emplace(conv, line1, line2);
-							}
-							else if (conv > lines1Convergence[line1].begin()->conv)
-							{
-								lines1Convergence[line1].clear();
-								lines1Convergence[line1].emplace(conv, line1, line2);
-							}
+							pairsSkipped.store(true, std::memory_order_relaxed);
+							break;
 						}
 					}
-					else
-					{
-#ifdef MULTITHREAD
-						Autolock lock(mtx);
-#endif
+				}
+			}
 
-						if (progress && !progress->Advance(linesProgress + 1))
-							return;
+			for (intptr_t candidate = 0; candidate < candidatesCount; ++candidate)
+			{
+				const intptr_t line2 = pruned ? candidates[candidate] : candidate;
 
-						linesProgress = 0;
-					}
+				if (chunk2[line2].empty())
+				{
+					++linesProgress;
+					continue;
 				}
-			}
-		};
 
-#ifdef MULTITHREAD
+				const intptr_t minSize = std::min(chunk1[line1].size(), chunk2[line2].size());
+				const intptr_t maxSize = std::max(chunk1[line1].size(), chunk2[line2].size());
 
-	auto threadFn =
-		[&](intptr_t startLine, intptr_t endLine)
-		{
-			try
-			{
-				workFn(startLine, endLine);
-			}
-			catch (std::exception& e)
-			{
-				char msg[128];
-				_snprintf_s(msg, _countof(msg), _TRUNCATE, "Exception occurred: %s", e.what());
-				::MessageBoxA(nppData._nppHandle, msg, "ComparePlus", MB_OK | MB_ICONWARNING);
-			}
-			catch (...)
-			{
-				::MessageBoxA(nppData._nppHandle, "Unknown exception occurred.", "ComparePlus",
-						MB_OK | MB_ICONWARNING);
-			}
-		};
+				if (((minSize * 100) / maxSize) < options.changedThresholdPercent)
+				{
+					++linesProgress;
+					continue;
+				}
 
-	int threadsCount = std::thread::hardware_concurrency() - 2;
+				intptr_t matchesCount	= 0;
+				intptr_t diffsCount		= 0;
 
-	if (threadsCount < 1)
-		threadsCount = 1;
+				// The least matches count giving line convergence above the threshold - the diffs stop as soon
+				// as it cannot be reached
+				const intptr_t minMatches = (minSize * options.changedThresholdPercent + 99) / 100;
 
-	if (threadsCount == 1)
-	{
-		LOGD(LOG_ALGO, "getOrderedConvergence(): only 1 worker thread available\n");
+				if (!options.detectCharDiffs)
+				{
+					if (words1.empty())
+					{
+						words1 = doc1.extractor->getLineWords(*doc1.text,
+								doc1.lines[blockDiff1.off + line1].line, options);
+						words1Lens = WordsLens(words1);
+					}
 
-		workFn(0, linesCount1);
-	}
-	else
-	{
-		const intptr_t totalJobs = linesCount1 * linesCount2;
+					const intptr_t maxD = diffDistanceLimit(words1.size(), words2[line2].size(),
+							wordsDiffMaxDistance(words1Lens, words2Lens[line2], minMatches));
+
+					if (maxD == 0)
+					{
+						++linesProgress;
+						continue;
+					}
 
-		intptr_t jobsPerThread = 50;
+					diff_type prevType = diff_type::DIFF_MATCH;
 
-		const intptr_t threadsNeeded = (totalJobs + jobsPerThread - 1) / jobsPerThread;
+					DiffCalc<Word>(words1, words2[line2], maxD).visit(
+						[&](const diff_info<void>& wd, bool swapped)
+						{
+							if (wd.type == diff_type::DIFF_MATCH)
+							{
+								const std::vector<Word>& rWord = swapped ? words2[line2] : words1;
 
-		if (threadsCount > static_cast<int>(threadsNeeded))
-			threadsCount = static_cast<int>(threadsNeeded);
+								matchesCount += (rWord[wd.off + wd.len - 1].pos + rWord[wd.off + wd.len - 1].len -
+										rWord[wd.off].pos);
+							}
+							// Count replacement as a single diff
+							else if (options.bestSeqChangedLines &&
+									!(wd.type == diff_type::DIFF_IN_2 && prevType == diff_type::DIFF_IN_1))
+							{
+								++diffsCount;
+							}
 
-		jobsPerThread = (totalJobs + threadsCount - 1) / threadsCount;
+							prevType = wd.type;
+						}, true);
 
-		LOGD(LOG_ALGO, "getOrderedConvergence(): threads to use: " + std::to_string(threadsCount) +
-				", jobs per thread: " + std::to_string(jobsPerThread) + "\n");
+					if (matchesCount == 0)
+					{
+						++linesProgress;
+						continue;
+					}
+				}
+				else if (useCharsLcs)
+				{
+					matchesCount = charsLcs1.length(chunk2[line2]);
+				}
+				else
+				{
+					const intptr_t maxD = diffDistanceLimit(chunk1[line1].size(), chunk2[line2].size(),
+							chunk1[line1].size() + chunk2[line2].size() - 2 * minMatches);
 
-		// Convert to line1 iterations per thread
-		jobsPerThread = (jobsPerThread + linesCount2 - 1) / linesCount2;
+					DiffCalc<Char>(chunk1[line1], chunk2[line2], maxD).visit(
+						[&](const diff_info<void>& cd, bool)
+						{
+							if (cd.type == diff_type::DIFF_MATCH)
+								matchesCount += cd.len;
+						});
+				}
 
-		std::vector<std::thread> threads;
+				if (((matchesCount * 100) / minSize) >= options.changedThresholdPercent)
+				{
+					const float lineConvergence = ((static_cast<float>(matchesCount) * 100) / minSize) +
+							((static_cast<float>(matchesCount) * 100) / maxSize);
 
-		intptr_t startLine = 0;
+					Conv conv(lineConvergence, diffsCount);
 
-		for (int th = 0; th < threadsCount; ++th)
-		{
-			const intptr_t endLine = ((th == (threadsCount - 1)) ? linesCount1 : (startLine + jobsPerThread));
+					++linesProgress;
 
-			LOGD(LOG_ALGO, "Thread " + std::to_string(th + 1) + " line1 range: " + std::to_string(startLine + 1) +
-					" to " + std::to_string(endLine) + "\n");
+					// Pairs worse than a line2 match of a previous line1 are not logged - they would be dropped by
+					// the lines tables update anyway
+					if ((lines2Best[line2].line1 < 0) || (conv > lines2Best[line2].conv))
+						lines2Best[line2].Set(conv, line1, line2);
+					else if ((lines2Best[line2].line1 < line1) && (lines2Best[line2].conv > conv))
+						continue;
 
-			try
-			{
-				threads.emplace_back(std::bind(threadFn, startLine, endLine));
-			}
-			catch (...)
-			{
-				workFn(startLine, linesCount1);
-				break;
+					accepted.emplace_back(conv, line1, line2);
+				}
+				else
+				{
+					++linesProgress;
+				}
 			}
 
-			startLine += jobsPerThread;
-		}
+			reportProgress(linesProgress);
+		});
 
-		for (auto& th : threads)
-			th.join();
+	for (const auto& accepted : linesAccepted)
+	{
+		for (const auto& lc : accepted)
+			addConvergence(lc);
 	}
 
-#else
-
-	workFn(0, linesCount1);
-
-#endif // MULTITHREAD
+	approximate = pairsSkipped;
 
 	return lines1Convergence;
 }
 
 
 bool compareBlocks(const DocCmpInfo& doc1, const DocCmpInfo& doc2, diffInfo& blockDiff1, diffInfo& blockDiff2,
-		const CompareOptions& options)
+		const CompareOptions& options, CompareProgress* progress, bool& approximate)
 {
 	std::vector<std::set<LinesConv>> orderedLinesConvergence =
-			getOrderedConvergence(doc1, doc2, blockDiff1, blockDiff2, options);
-
-	{
-		progress_ptr& progress = ProgressDlg::Get();
+			getOrderedConvergence(doc1, doc2, blockDiff1, blockDiff2, options, progress, approximate);
 
-		if (progress && progress->IsCancelled())
-			return false;
-	}
+	if (progress && progress->IsCancelled())
+		return false;
 
 #ifdef DLOG
 	for (const auto& oc: orderedLinesConvergence)
@@ -1678,7 +2514,7 @@ bool compareBlocks(const DocCmpInfo& doc1, const DocCmpInfo& doc2, diffInfo& blo
 }
 
 
-void markSection(const DocCmpInfo& doc, const diffInfo& bd, const CompareOptions& options)
+void markSection(const DocCmpInfo& doc, const diffInfo& bd, const CompareOptions& options, DiffSink& sink)
 {
 	const intptr_t endOff = doc.section.off + doc.section.len;
 
@@ -1699,12 +2535,12 @@ void markSection(const DocCmpInfo& doc, const diffInfo& bd, const CompareOptions
 				const int mark = (doc.nonUniqueLines.find(docLine) == doc.nonUniqueLines.end()) ? doc.blockDiffMask :
 						(doc.blockDiffMask == MARKER_MASK_ADDED) ? MARKER_MASK_ADDED_LOCAL : MARKER_MASK_REMOVED_LOCAL;
 
-				CallScintilla(doc.view, SCI_MARKERADDSET, docLine, mark);
+				sink.markLine(doc.view, docLine, mark);
 
 				if (options.ignoreEmptyLines && !options.neverMarkIgnored)
 				{
 					for (; prevLine < docLine; ++prevLine)
-						CallScintilla(doc.view, SCI_MARKERADDSET, prevLine, doc.blockDiffMask & MARKER_MASK_LINE);
+						sink.markLine(doc.view, prevLine, doc.blockDiffMask & MARKER_MASK_LINE);
 
 					prevLine = docLine + 1;
 				}
@@ -1715,11 +2551,11 @@ void markSection(const DocCmpInfo& doc, const diffInfo& bd, const CompareOptions
 		}
 		else if (movedLen == 1)
 		{
-			CallScintilla(doc.view, SCI_MARKERADDSET, doc.lines[line].line, MARKER_MASK_MOVED_LINE);
+			sink.markLine(doc.view, doc.lines[line].line, MARKER_MASK_MOVED_LINE);
 		}
 		else
 		{
-			CallScintilla(doc.view, SCI_MARKERADDSET, doc.lines[line].line, MARKER_MASK_MOVED_BEGIN);
+			sink.markLine(doc.view, doc.lines[line].line, MARKER_MASK_MOVED_BEGIN);
 
 			i += --movedLen;
 
@@ -1729,62 +2565,55 @@ void markSection(const DocCmpInfo& doc, const diffInfo& bd, const CompareOptions
 			for (++line; line < endLine; ++line)
 			{
 				const intptr_t docLine = doc.lines[line].line;
-				CallScintilla(doc.view, SCI_MARKERADDSET, docLine, MARKER_MASK_MOVED_MID);
+				sink.markLine(doc.view, docLine, MARKER_MASK_MOVED_MID);
 
 				if (options.ignoreEmptyLines && !options.neverMarkIgnored)
 				{
 					for (; prevLine < docLine; ++prevLine)
-						CallScintilla(doc.view, SCI_MARKERADDSET, prevLine, MARKER_MASK_MOVED_MID & MARKER_MASK_LINE);
+						sink.markLine(doc.view, prevLine, MARKER_MASK_MOVED_MID & MARKER_MASK_LINE);
 
 					prevLine = docLine + 1;
 				}
 			}
 
 			const intptr_t docLine = doc.lines[line].line;
-			CallScintilla(doc.view, SCI_MARKERADDSET, docLine, MARKER_MASK_MOVED_END);
+			sink.markLine(doc.view, docLine, MARKER_MASK_MOVED_END);
 
 			if (options.ignoreEmptyLines && !options.neverMarkIgnored)
 			{
 				for (; prevLine < docLine; ++prevLine)
-					CallScintilla(doc.view, SCI_MARKERADDSET, prevLine, MARKER_MASK_MOVED_MID & MARKER_MASK_LINE);
+					sink.markLine(doc.view, prevLine, MARKER_MASK_MOVED_MID & MARKER_MASK_LINE);
 			}
 		}
 	}
 }
 
 
-void markLineDiffs(const CompareInfo& cmpInfo, const diffInfo& bd, intptr_t lineIdx)
+void markLineDiffs(const CompareInfo& cmpInfo, const diffInfo& bd, intptr_t lineIdx, DiffSink& sink)
 {
 	intptr_t line = cmpInfo.doc1.lines[bd.off + bd.info.changedLines[lineIdx].line].line;
-	intptr_t linePos = getLineStart(cmpInfo.doc1.view, line);
-	int color = (cmpInfo.doc1.blockDiffMask == MARKER_MASK_ADDED) ?
-			Settings.colors().add_highlight : Settings.colors().rem_highlight;
 
-	for (const auto& change: bd.info.changedLines[lineIdx].changes)
-		markTextAsChanged(cmpInfo.doc1.view, linePos + change.off, change.len, color);
+	sink.markLineChanges(cmpInfo.doc1.view, line, bd.info.changedLines[lineIdx].changes,
+			cmpInfo.doc1.blockDiffMask);
 
-	CallScintilla(cmpInfo.doc1.view, SCI_MARKERADDSET, line,
+	sink.markLine(cmpInfo.doc1.view, line,
 			cmpInfo.doc1.nonUniqueLines.find(line) == cmpInfo.doc1.nonUniqueLines.end() ?
 			MARKER_MASK_CHANGED : MARKER_MASK_CHANGED_LOCAL);
 
 	line = cmpInfo.doc2.lines[bd.info.matchBlock->off + bd.info.matchBlock->info.changedLines[lineIdx].line].line;
-	linePos = getLineStart(cmpInfo.doc2.view, line);
-	color = (cmpInfo.doc2.blockDiffMask == MARKER_MASK_ADDED) ?
-			Settings.colors().add_highlight : Settings.colors().rem_highlight;
 
-	for (const auto& change: bd.info.matchBlock->info.changedLines[lineIdx].changes)
-		markTextAsChanged(cmpInfo.doc2.view, linePos + change.off, change.len, color);
+	sink.markLineChanges(cmpInfo.doc2.view, line, bd.info.matchBlock->info.changedLines[lineIdx].changes,
+			cmpInfo.doc2.blockDiffMask);
 
-	CallScintilla(cmpInfo.doc2.view, SCI_MARKERADDSET, line,
+	sink.markLine(cmpInfo.doc2.view, line,
 			cmpInfo.doc2.nonUniqueLines.find(line) == cmpInfo.doc2.nonUniqueLines.end() ?
 			MARKER_MASK_CHANGED : MARKER_MASK_CHANGED_LOCAL);
 }
 
 
-bool markAllDiffs(CompareInfo& cmpInfo, const CompareOptions& options, CompareSummary& summary)
+bool markAllDiffs(CompareInfo& cmpInfo, const CompareOptions& options, CompareSummary& summary, DiffSink& sink,
+		CompareProgress* progress)
 {
-	progress_ptr& progress = ProgressDlg::Get();
-
 	summary.clear();
 
 	const intptr_t blockDiffSize = static_cast<intptr_t>(cmpInfo.blockDiffs.size());
@@ -1870,7 +2699,7 @@ bool markAllDiffs(CompareInfo& cmpInfo, const CompareOptions& options, CompareSu
 		{
 			cmpInfo.doc2.section.off = 0;
 			cmpInfo.doc2.section.len = bd.len;
-			markSection(cmpInfo.doc2, bd, options);
+			markSection(cmpInfo.doc2, bd, options, sink);
 
 			pMainAlignData->diffMask	= 0;
 			pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
@@ -1953,13 +2782,13 @@ bool markAllDiffs(CompareInfo& cmpInfo, const CompareOptions& options, CompareSu
 
 						if (cmpInfo.doc1.section.len)
 						{
-							markSection(cmpInfo.doc1, bd, options);
+							markSection(cmpInfo.doc1, bd, options, sink);
 							alignLines.first += cmpInfo.doc1.section.len;
 						}
 
 						if (cmpInfo.doc2.section.len)
 						{
-							markSection(cmpInfo.doc2, *bd.info.matchBlock, options);
+							markSection(cmpInfo.doc2, *bd.info.matchBlock, options, sink);
 							alignLines.second += cmpInfo.doc2.section.len;
 						}
 
@@ -1974,7 +2803,7 @@ bool markAllDiffs(CompareInfo& cmpInfo, const CompareOptions& options, CompareSu
 
 					summary.alignmentInfo.emplace_back(alignPair);
 
-					markLineDiffs(cmpInfo, bd, j);
+					markLineDiffs(cmpInfo, bd, j, sink);
 
 					cmpInfo.doc1.section.off = bd.info.changedLines[j].line + 1;
 					cmpInfo.doc2.section.off = bd.info.matchBlock->info.changedLines[j].line + 1;
@@ -2033,13 +2862,13 @@ bool markAllDiffs(CompareInfo& cmpInfo, const CompareOptions& options, CompareSu
 
 					if (cmpInfo.doc1.section.len)
 					{
-						markSection(cmpInfo.doc1, bd, options);
+						markSection(cmpInfo.doc1, bd, options, sink);
 						alignLines.first += cmpInfo.doc1.section.len;
 					}
 
 					if (cmpInfo.doc2.section.len)
 					{
-						markSection(cmpInfo.doc2, *bd.info.matchBlock, options);
+						markSection(cmpInfo.doc2, *bd.info.matchBlock, options, sink);
 						alignLines.second += cmpInfo.doc2.section.len;
 					}
 
@@ -2073,7 +2902,7 @@ bool markAllDiffs(CompareInfo& cmpInfo, const CompareOptions& options, CompareSu
 			{
 				cmpInfo.doc1.section.off = 0;
 				cmpInfo.doc1.section.len = bd.len;
-				markSection(cmpInfo.doc1, bd, options);
+				markSection(cmpInfo.doc1, bd, options, sink);
 
 				pMainAlignData->diffMask	= cmpInfo.doc1.blockDiffMask;
 				pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
@@ -2110,14 +2939,26 @@ bool markAllDiffs(CompareInfo& cmpInfo, const CompareOptions& options, CompareSu
 }
 
 
-CompareResult runCompare(const CompareOptions& options, CompareSummary& summary)
+}
+
+
+CompareResult runCompare(const DocumentSource& mainDoc, const DocumentSource& subDoc, DiffSink& sink,
+		const CompareOptions& options, CompareSummary& summary, CompareProgress* progress)
 {
-	progress_ptr& progress = ProgressDlg::Get();
+	TextSnapshot mainText;
+	TextSnapshot subText;
+
+	mainText.take(mainDoc);
+	subText.take(subDoc);
 
 	CompareInfo cmpInfo;
 
 	cmpInfo.doc1.view	= MAIN_VIEW;
+	cmpInfo.doc1.text	= &mainText;
 	cmpInfo.doc2.view	= SUB_VIEW;
+	cmpInfo.doc2.text	= &subText;
+
+	cmpInfo.doc1.extractor = cmpInfo.doc2.extractor = selectTextExtractor(options);
 
 	if (options.selectionCompare)
 	{
@@ -2133,17 +2974,24 @@ CompareResult runCompare(const CompareOptions& options, CompareSummary& summary)
 
 	LOGD_GET_TIME;
 
-	getLines(cmpInfo.doc1, options);
+	getLines(cmpInfo.doc1, cmpInfo.doc2, options, progress);
 
 	if (progress && !progress->NextPhase())
 		return CompareResult::COMPARE_CANCELLED;
 
-	getLines(cmpInfo.doc2, options);
+	const uint32_t classesCount = internLines(cmpInfo.doc1, cmpInfo.doc2);
 
-	if (progress && !progress->NextPhase())
-		return CompareResult::COMPARE_CANCELLED;
+	DiffCalc<uint32_t, blockDiffInfo> linesDiffCalc(cmpInfo.doc1.lineIds, cmpInfo.doc2.lineIds);
 
-	auto diffRes = DiffCalc<Line, blockDiffInfo>(cmpInfo.doc1.lines, cmpInfo.doc2.lines)(true, true);
+	linesDiffCalc.set_parallel(getWorkersCount());
+	linesDiffCalc.set_tasks_runner(runDiffTasks);
+	linesDiffCalc.set_orientation((getWorkersCount() > 1) ?
+			diff_orientation::CHECK_BOTH_CONCURRENTLY : diff_orientation::CHECK_BOTH);
+	linesDiffCalc.set_bounded_cost(!options.minimalLinesDiff);
+	linesDiffCalc.set_classes_count(classesCount);
+
+	auto diffRes = linesDiffCalc(true, true, options.discardUnmatchedLines,
+			options.histogramDiff ? diff_algorithm::HISTOGRAM : diff_algorithm::MYERS);
 	cmpInfo.blockDiffs = std::move(diffRes.first);
 
 	if (diffRes.second)
@@ -2157,7 +3005,7 @@ CompareResult runCompare(const CompareOptions& options, CompareSummary& summary)
 	if (blockDiffsSize == 0 || (blockDiffsSize == 1 && cmpInfo.blockDiffs[0].type == diff_type::DIFF_MATCH))
 		return CompareResult::COMPARE_MATCH;
 
-	findUniqueLines(cmpInfo);
+	findUniqueLines(cmpInfo, classesCount);
 
 	if (options.detectMoves)
 		findMoves(cmpInfo);
@@ -2180,44 +3028,77 @@ CompareResult runCompare(const CompareOptions& options, CompareSummary& summary)
 		}
 	}
 
+	std::unique_ptr<SharedProgress> blocksProgress;
+
 	if (progress)
 	{
 		progress->SetMaxCount(changedProgressCount);
 
 		if (changedProgressCount > 10000)
 			progress->Show();
+
+		blocksProgress = std::make_unique<SharedProgress>(*progress);
 	}
 
-	// Do block compares
-	for (intptr_t i: changedBlockIdx)
-	{
-		diffInfo& blockDiff1 = cmpInfo.blockDiffs[i - 1];
-		diffInfo& blockDiff2 = cmpInfo.blockDiffs[i];
+	// The blocks are independent and compared concurrently - the biggest ones first so none of them is left last
+	// for a single thread
+	std::stable_sort(changedBlockIdx.begin(), changedBlockIdx.end(),
+		[&](intptr_t idx1, intptr_t idx2)
+		{
+			return (cmpInfo.blockDiffs[idx1].len * cmpInfo.blockDiffs[idx1 - 1].len >
+					cmpInfo.blockDiffs[idx2].len * cmpInfo.blockDiffs[idx2 - 1].len);
+		});
 
-		blockDiff1.info.matchBlock = &blockDiff2;
-		blockDiff2.info.matchBlock = &blockDiff1;
+	std::atomic<intptr_t> nextBlock {0};
+	std::atomic<bool> cancelled {false};
+	std::atomic<bool> blocksApproximate {false};
 
-		if (!compareBlocks(cmpInfo.doc1, cmpInfo.doc2, blockDiff1, blockDiff2, options))
-			return CompareResult::COMPARE_CANCELLED;
-	}
+	// Each job compares the biggest block not taken yet
+	parallelFor(static_cast<intptr_t>(changedBlockIdx.size()), getWorkersCount(),
+		[&](intptr_t, int)
+		{
+			const intptr_t i = changedBlockIdx[nextBlock++];
+
+			if (cancelled)
+				return;
+
+			diffInfo& blockDiff1 = cmpInfo.blockDiffs[i - 1];
+			diffInfo& blockDiff2 = cmpInfo.blockDiffs[i];
+
+			blockDiff1.info.matchBlock = &blockDiff2;
+			blockDiff2.info.matchBlock = &blockDiff1;
+
+			bool approximate = false;
+
+			if (!compareBlocks(cmpInfo.doc1, cmpInfo.doc2, blockDiff1, blockDiff2, options, blocksProgress.get(),
+					approximate))
+				cancelled = true;
+
+			if (approximate)
+				blocksApproximate = true;
+		});
+
+	if (cancelled || (blocksProgress && !blocksProgress->flush()))
+		return CompareResult::COMPARE_CANCELLED;
 
 	if (progress && !progress->NextPhase())
 		return CompareResult::COMPARE_CANCELLED;
 
-	clearWindow(MAIN_VIEW);
-	clearWindow(SUB_VIEW);
+	sink.clear(MAIN_VIEW);
+	sink.clear(SUB_VIEW);
 
-	if (!markAllDiffs(cmpInfo, options, summary))
+	if (!markAllDiffs(cmpInfo, options, summary, sink, progress))
 		return CompareResult::COMPARE_CANCELLED;
 
+	summary.approximate = linesDiffCalc.approximate() || blocksApproximate;
+
 	return CompareResult::COMPARE_MISMATCH;
 }
 
 
-CompareResult runFindUnique(const CompareOptions& options, CompareSummary& summary)
+CompareResult runFindUnique(const DocumentSource& mainDoc, const DocumentSource& subDoc, DiffSink& sink,
+		const CompareOptions& options, CompareSummary& summary, CompareProgress* progress)
 {
-	progress_ptr& progress = ProgressDlg::Get();
-
 	summary.alignmentInfo.clear();
 
 	summary.diffLines	= 0;
@@ -2227,11 +3108,23 @@ CompareResult runFindUnique(const CompareOptions& options, CompareSummary& summa
 	summary.changed		= 0;
 	summary.match		= 0;
 
+	summary.approximate	= false;
+
+	TextSnapshot mainText;
+	TextSnapshot subText;
+
+	mainText.take(mainDoc);
+	subText.take(subDoc);
+
 	DocCmpInfo doc1;
 	DocCmpInfo doc2;
 
 	doc1.view	= MAIN_VIEW;
+	doc1.text	= &mainText;
 	doc2.view	= SUB_VIEW;
+	doc2.text	= &subText;
+
+	doc1.extractor = doc2.extractor = selectTextExtractor(options);
 
 	if (options.selectionCompare)
 	{
@@ -2253,12 +3146,7 @@ CompareResult runFindUnique(const CompareOptions& options, CompareSummary& summa
 		doc2.blockDiffMask = MARKER_MASK_ADDED;
 	}
 
-	getLines(doc1, options);
-
-	if (progress && !progress->NextPhase())
-		return CompareResult::COMPARE_CANCELLED;
-
-	getLines(doc2, options);
+	getLines(doc1, doc2, options, progress);
 
 	if (progress && !progress->NextPhase())
 		return CompareResult::COMPARE_CANCELLED;
@@ -2291,8 +3179,8 @@ CompareResult runFindUnique(const CompareOptions& options, CompareSummary& summa
 	if (progress && !progress->NextPhase())
 		return CompareResult::COMPARE_CANCELLED;
 
-	clearWindow(MAIN_VIEW);
-	clearWindow(SUB_VIEW);
+	sink.clear(MAIN_VIEW);
+	sink.clear(SUB_VIEW);
 
 	intptr_t doc1UniqueLinesCount = 0;
 
@@ -2309,7 +3197,7 @@ CompareResult runFindUnique(const CompareOptions& options, CompareSummary& summa
 		{
 			for (const auto& line: uniqueLine.second)
 			{
-				CallScintilla(doc1.view, SCI_MARKERADDSET, line, doc1.blockDiffMask);
+				sink.markLine(doc1.view, line, doc1.blockDiffMask);
 				++doc1UniqueLinesCount;
 			}
 		}
@@ -2326,7 +3214,7 @@ CompareResult runFindUnique(const CompareOptions& options, CompareSummary& summa
 	for (const auto& uniqueLine: doc2UniqueLines)
 	{
 		for (const auto& line: uniqueLine.second)
-			CallScintilla(doc2.view, SCI_MARKERADDSET, line, doc2.blockDiffMask);
+			sink.markLine(doc2.view, line, doc2.blockDiffMask);
 
 		if (doc2.blockDiffMask == MARKER_MASK_ADDED)
 			summary.added += uniqueLine.second.size();
@@ -2343,48 +3231,10 @@ CompareResult runFindUnique(const CompareOptions& options, CompareSummary& summa
 	return CompareResult::COMPARE_MISMATCH;
 }
 
-}
-
 
-CompareResult compareViews(const CompareOptions& options, const TCHAR* progressInfo, CompareSummary& summary)
+void setWorkerThreads(int threadsCount)
 {
-	CompareResult result = CompareResult::COMPARE_ERROR;
-
-	if (progressInfo)
-		ProgressDlg::Open(progressInfo);
-
-	try
-	{
-		if (options.findUniqueMode)
-			result = runFindUnique(options, summary);
-		else
-			result = runCompare(options, summary);
-
-		ProgressDlg::Close();
-
-		if (result != CompareResult::COMPARE_MISMATCH)
-		{
-			clearWindow(MAIN_VIEW);
-			clearWindow(SUB_VIEW);
-		}
-	}
-	catch (std::exception& e)
-	{
-		ProgressDlg::Close();
-
-		clearWindow(MAIN_VIEW);
-		clearWindow(SUB_VIEW);
-
-		char msg[128];
-		_snprintf_s(msg, _countof(msg), _TRUNCATE, "Exception occurred: %s", e.what());
-		::MessageBoxA(nppData._nppHandle, msg, "ComparePlus", MB_OK | MB_ICONWARNING);
-	}
-	catch (...)
-	{
-		ProgressDlg::Close();
-
-		::MessageBoxA(nppData._nppHandle, "Unknown exception occurred.", "ComparePlus", MB_OK | MB_ICONWARNING);
-	}
-
-	return result;
+#ifdef MULTITHREAD
+	ThreadPool::setWorkersCount((threadsCount > 0) ? threadsCount - 1 : -1);
+#endif
 }
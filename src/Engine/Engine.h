@@ -19,7 +19,6 @@
 
 #pragma once
 
-#include <windows.h>
 #include <cstdint>
 #include <vector>
 #include <utility>
@@ -27,8 +26,17 @@
 #include <string>
 #include <regex>
 
-#include "Compare.h"
-#include "NppHelpers.h"
+#include "Markers.h"
+
+
+// Compared documents indexes - the same as Notepad++ views ids
+#ifndef MAIN_VIEW
+#define MAIN_VIEW	0
+#endif
+
+#ifndef SUB_VIEW
+#define SUB_VIEW	1
+#endif
 
 
 enum class CompareResult
@@ -79,7 +87,11 @@ struct CompareOptions
 	bool	neverMarkIgnored;
 	bool	detectMoves;
 	bool	detectCharDiffs;
+	bool	fastCharDiffs;
 	bool	bestSeqChangedLines;
+	bool	histogramDiff;
+	bool	discardUnmatchedLines;
+	bool	minimalLinesDiff;
 	bool	ignoreSpaces;
 	bool	ignoreEmptyLines;
 	bool	ignoreCase;
@@ -122,6 +134,8 @@ struct CompareSummary
 		changed		= 0;
 		match		= 0;
 
+		approximate	= false;
+
 		alignmentInfo.clear();
 	}
 
@@ -132,8 +146,78 @@ struct CompareSummary
 	intptr_t	changed;
 	intptr_t	match;
 
+	// The lines diff is not minimal or changed lines were matched among the likely similar ones only - the files
+	// differ too much for exact compare in reasonable time
+	bool		approximate {false};
+
 	AlignmentInfo_t	alignmentInfo;
 };
 
 
-CompareResult compareViews(const CompareOptions& options, const TCHAR* progressInfo, CompareSummary& summary);
+/**
+ *  \class  DocumentSource
+ *  \brief  Compare engine input - read-only access to the compared document text (UTF-8 encoded)
+ */
+class DocumentSource
+{
+public:
+	virtual ~DocumentSource() = default;
+
+	// Contiguous document text - must stay valid and unchanged until the compare returns
+	virtual const char* text() const = 0;
+	virtual intptr_t length() const = 0;
+};
+
+
+/**
+ *  \class  DiffSink
+ *  \brief  Compare engine output - receives the found differences marks
+ */
+class DiffSink
+{
+public:
+	virtual ~DiffSink() = default;
+
+	// Clears all previous compare marks in the document
+	virtual void clear(int view) = 0;
+
+	// Adds markMask (MARKER_MASK_...) markers set to the line
+	virtual void markLine(int view, intptr_t line, int markMask) = 0;
+
+	// Highlights line changed sections (offsets are relative to the line start). blockDiffMask is the
+	// MARKER_MASK_ADDED / MARKER_MASK_REMOVED mask of the document block the line belongs to
+	virtual void markLineChanges(int view, intptr_t line, const std::vector<section_t>& changes,
+			int blockDiffMask) = 0;
+};
+
+
+/**
+ *  \class  CompareProgress
+ *  \brief  Compare engine progress report and cancel requests monitor
+ */
+class CompareProgress
+{
+public:
+	virtual ~CompareProgress() = default;
+
+	virtual void Show() = 0;
+	virtual bool IsCancelled() const = 0;
+
+	virtual unsigned NextPhase() = 0;
+	virtual bool SetMaxCount(intptr_t max) = 0;
+	virtual bool Advance(intptr_t cnt = 1) = 0;
+};
+
+
+// Compare engine entry points - mainDoc and subDoc are referred to as MAIN_VIEW and SUB_VIEW in options and
+// output. progress can be nullptr. Exceptions are propagated to the caller.
+CompareResult runCompare(const DocumentSource& mainDoc, const DocumentSource& subDoc, DiffSink& sink,
+		const CompareOptions& options, CompareSummary& summary, CompareProgress* progress = nullptr);
+
+CompareResult runFindUnique(const DocumentSource& mainDoc, const DocumentSource& subDoc, DiffSink& sink,
+		const CompareOptions& options, CompareSummary& summary, CompareProgress* progress = nullptr);
+
+// Sets the threads count compares run on, the calling thread included (0 - all hardware threads). The engine's
+// worker threads are created on first compare and kept for the next ones - a changed count is applied when no
+// compare runs
+void setWorkerThreads(int threadsCount);
@@ -0,0 +1,232 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <cstring>
+
+#include "LineHash.h"
+#include "LineHashKernel.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define HASH_SSE2		1
+#include <emmintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+
+namespace {
+
+#ifdef HASH_SSE2
+
+struct Sse2Kernel
+{
+	static inline void accumulate(uint64_t* acc, const unsigned char* stripe, const uint64_t* stripeKey)
+	{
+		const __m128i key01 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stripeKey));
+		const __m128i key23 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stripeKey + 2));
+
+		__m128i acc01 = _mm_load_si128(reinterpret_cast<const __m128i*>(acc));
+		__m128i acc23 = _mm_load_si128(reinterpret_cast<const __m128i*>(acc + 2));
+
+		const __m128i data01 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stripe));
+		const __m128i data23 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stripe + 16));
+
+		const __m128i k01 = _mm_xor_si128(data01, key01);
+		const __m128i k23 = _mm_xor_si128(data23, key23);
+
+		acc01 = _mm_add_epi64(acc01, _mm_mul_epu32(k01, _mm_srli_epi64(k01, 32)));
+		acc23 = _mm_add_epi64(acc23, _mm_mul_epu32(k23, _mm_srli_epi64(k23, 32)));
+
+		acc01 = _mm_add_epi64(acc01, _mm_shuffle_epi32(data01, _MM_SHUFFLE(1, 0, 3, 2)));
+		acc23 = _mm_add_epi64(acc23, _mm_shuffle_epi32(data23, _MM_SHUFFLE(1, 0, 3, 2)));
+
+		_mm_store_si128(reinterpret_cast<__m128i*>(acc), acc01);
+		_mm_store_si128(reinterpret_cast<__m128i*>(acc + 2), acc23);
+	}
+
+	template <bool IgnoreSpaces, bool IgnoreCase>
+	static inline intptr_t filterHalf(const unsigned char* src, unsigned char* dst)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+
+		if (IgnoreCase)
+		{
+			// 'A'..'Z' become the 26 smallest signed values after the shift
+			const __m128i shifted	= _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(0x80 - 'A')));
+			const __m128i isUpper	= _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(0x80 + 26)));
+
+			v = _mm_add_epi8(v, _mm_and_si128(isUpper, _mm_set1_epi8(0x20)));
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v);
+
+		if (!IgnoreSpaces)
+			return 16;
+
+		const __m128i spaces = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+
+		return compact(dst, static_cast<uint32_t>(_mm_movemask_epi8(spaces)), 16);
+	}
+
+	template <bool IgnoreSpaces, bool IgnoreCase>
+	static inline intptr_t filter(const unsigned char* stripe, unsigned char* dst)
+	{
+		const intptr_t n = filterHalf<IgnoreSpaces, IgnoreCase>(stripe, dst);
+
+		return n + filterHalf<IgnoreSpaces, IgnoreCase>(stripe + 16, dst + n);
+	}
+};
+
+
+
+bool cpuHasAvx2()
+{
+#ifdef _MSC_VER
+	int regs[4];
+
+	__cpuid(regs, 0);
+
+	if (regs[0] < 7)
+		return false;
+
+	__cpuid(regs, 1);
+
+	// OSXSAVE and AVX bits, then check that the OS saves the YMM registers
+	if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0)
+		return false;
+
+	if ((_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(regs, 7, 0);
+
+	return ((regs[1] & (1 << 5)) != 0);
+#else
+	__builtin_cpu_init();
+
+	return (__builtin_cpu_supports("avx2") != 0);
+#endif
+}
+
+#endif // HASH_SSE2
+
+}
+
+
+HashKernel bestHashKernel()
+{
+	if (isHashKernelSupported(HashKernel::AVX2))
+		return HashKernel::AVX2;
+
+	if (isHashKernelSupported(HashKernel::SSE2))
+		return HashKernel::SSE2;
+
+	return HashKernel::SCALAR;
+}
+
+
+bool isHashKernelSupported(HashKernel kernel)
+{
+	switch (kernel)
+	{
+#ifdef HASH_SSE2
+		case HashKernel::AVX2:
+		{
+			static const bool hasAvx2 = isAvx2KernelBuilt() && cpuHasAvx2();
+
+			return hasAvx2;
+		}
+
+		case HashKernel::SSE2:
+			return true;
+#endif
+
+		case HashKernel::SCALAR:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+
+template <bool IgnoreSpaces, bool IgnoreCase>
+uint64_t hashLine(HashKernel kernel, uint64_t seed, const char* text, intptr_t len)
+{
+	const unsigned char* uText = reinterpret_cast<const unsigned char*>(text);
+
+	switch (kernel)
+	{
+#ifdef HASH_SSE2
+		case HashKernel::AVX2:
+			return hashLineAvx2<IgnoreSpaces, IgnoreCase>(seed, uText, len);
+
+		case HashKernel::SSE2:
+			return hashLineWith<Sse2Kernel, IgnoreSpaces, IgnoreCase>(seed, uText, len);
+#endif
+
+		default:
+			return hashLineWith<ScalarKernel, IgnoreSpaces, IgnoreCase>(seed, uText, len);
+	}
+}
+
+
+template uint64_t hashLine<false, false>(HashKernel kernel, uint64_t seed, const char* text, intptr_t len);
+template uint64_t hashLine<true, false>(HashKernel kernel, uint64_t seed, const char* text, intptr_t len);
+template uint64_t hashLine<false, true>(HashKernel kernel, uint64_t seed, const char* text, intptr_t len);
+template uint64_t hashLine<true, true>(HashKernel kernel, uint64_t seed, const char* text, intptr_t len);
+
+
+uint64_t hashLine(HashKernel kernel, uint64_t seed, const char* text, intptr_t len,
+		bool ignoreSpaces, bool ignoreCase)
+{
+	if (ignoreSpaces)
+		return ignoreCase ? hashLine<true, true>(kernel, seed, text, len) :
+				hashLine<true, false>(kernel, seed, text, len);
+
+	return ignoreCase ? hashLine<false, true>(kernel, seed, text, len) :
+			hashLine<false, false>(kernel, seed, text, len);
+}
+
+
+bool isAscii(const char* text, intptr_t len)
+{
+	const unsigned char* uText = reinterpret_cast<const unsigned char*>(text);
+
+	intptr_t pos = 0;
+
+#ifdef HASH_SSE2
+	for (; pos + 16 <= len; pos += 16)
+	{
+		if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(uText + pos))))
+			return false;
+	}
+#endif
+
+	for (; pos < len; ++pos)
+	{
+		if (uText[pos] & 0x80)
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+
+const uint64_t cHashSeed = 0x84222325;
+
+
+// Incremental per-char hash - used where text is hashed while being split (words, regex ignored ranges)
+template<typename CharT>
+inline uint64_t Hash(uint64_t hval, CharT letter)
+{
+	hval ^= static_cast<uint64_t>(letter);
+
+	hval += (hval << 1) + (hval << 4) + (hval << 5) + (hval << 7) + (hval << 8) + (hval << 40);
+
+	return hval;
+}
+
+
+enum class HashKernel
+{
+	SCALAR,
+	SSE2,
+	AVX2
+};
+
+
+// The fastest kernel supported by the CPU
+HashKernel bestHashKernel();
+
+bool isHashKernelSupported(HashKernel kernel);
+
+
+// Whole line hash - consumes 32 bytes per step. IgnoreSpaces skips ' ' and '\t' and IgnoreCase folds ASCII letters
+// in the same pass. All kernels give the same result. Returns seed if there is nothing to hash after filtering.
+// Instantiated for all 4 flags combinations.
+template <bool IgnoreSpaces, bool IgnoreCase>
+uint64_t hashLine(HashKernel kernel, uint64_t seed, const char* text, intptr_t len);
+
+template <bool IgnoreSpaces, bool IgnoreCase>
+inline uint64_t hashLine(uint64_t seed, const char* text, intptr_t len)
+{
+	static const HashKernel kernel = bestHashKernel();
+
+	return hashLine<IgnoreSpaces, IgnoreCase>(kernel, seed, text, len);
+}
+
+// Same as above with the flags picked at run time
+uint64_t hashLine(HashKernel kernel, uint64_t seed, const char* text, intptr_t len,
+		bool ignoreSpaces, bool ignoreCase);
+
+
+bool isAscii(const char* text, intptr_t len);
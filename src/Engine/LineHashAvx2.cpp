@@ -0,0 +1,175 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <cstring>
+
+#include "LineHashKernel.h"
+
+// GCC needs -mavx2 for this file (set by the build), MSVC allows the AVX2 intrinsics anyway
+#if defined(__AVX2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#define HASH_AVX2		1
+#include <immintrin.h>
+#endif
+
+
+#ifdef HASH_AVX2
+
+namespace {
+
+/**
+ *  \class  CompactTable
+ *  \brief  Byte shuffle control for each 8-bit mask of bytes to remove (kept bytes packed to the front)
+ */
+struct CompactTable
+{
+	CompactTable()
+	{
+		for (int mask = 0; mask < 256; ++mask)
+		{
+			uint64_t shuffle = 0;
+			int n = 0;
+
+			for (int i = 0; i < 8; ++i)
+			{
+				if (!(mask & (1 << i)))
+					shuffle |= static_cast<uint64_t>(i) << (8 * n++);
+			}
+
+			shuffles[mask]	= shuffle;
+			kept[mask]		= static_cast<uint8_t>(n);
+		}
+	}
+
+	uint64_t	shuffles[256];
+	uint8_t		kept[256];
+};
+
+
+const CompactTable cCompactTable;
+
+
+struct Avx2Kernel
+{
+	static inline void accumulate(uint64_t* acc, const unsigned char* stripe, const uint64_t* stripeKey)
+	{
+		const __m256i key	= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stripeKey));
+		const __m256i data	= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stripe));
+		const __m256i k		= _mm256_xor_si256(data, key);
+
+		__m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(acc));
+
+		a = _mm256_add_epi64(a, _mm256_mul_epu32(k, _mm256_srli_epi64(k, 32)));
+		a = _mm256_add_epi64(a, _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+
+		_mm256_store_si256(reinterpret_cast<__m256i*>(acc), a);
+	}
+
+	template <bool IgnoreSpaces, bool IgnoreCase>
+	static inline intptr_t filter(const unsigned char* stripe, unsigned char* dst)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stripe));
+
+		if (IgnoreCase)
+		{
+			const __m256i shifted	= _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(0x80 - 'A')));
+			const __m256i isUpper	= _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(0x80 + 26)), shifted);
+
+			v = _mm256_add_epi8(v, _mm256_and_si256(isUpper, _mm256_set1_epi8(0x20)));
+		}
+
+		if (!IgnoreSpaces)
+		{
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), v);
+			return cStripeLen;
+		}
+
+		const __m256i spaces = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+
+		const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(spaces));
+
+		if (mask == 0)
+		{
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), v);
+			return cStripeLen;
+		}
+
+		// Pack each 8 bytes group with a single shuffle and store the groups one after another
+		intptr_t n = compactHalf(_mm256_castsi256_si128(v), mask & 0xFFFF, dst);
+		n += compactHalf(_mm256_extracti128_si256(v, 1), mask >> 16, dst + n);
+
+		return n;
+	}
+
+	static inline intptr_t compactHalf(__m128i v, uint32_t mask, unsigned char* dst)
+	{
+		const uint32_t loMask = mask & 0xFF;
+		const uint32_t hiMask = mask >> 8;
+
+		const __m128i shuffle = _mm_set_epi64x(
+				static_cast<long long>(cCompactTable.shuffles[hiMask] + 0x0808080808080808ULL),
+				static_cast<long long>(cCompactTable.shuffles[loMask]));
+
+		const __m128i packed = _mm_shuffle_epi8(v, shuffle);
+
+		const intptr_t loKept = cCompactTable.kept[loMask];
+
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst), packed);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + loKept), _mm_unpackhi_epi64(packed, packed));
+
+		return loKept + cCompactTable.kept[hiMask];
+	}
+};
+
+}
+
+
+bool isAvx2KernelBuilt()
+{
+	return true;
+}
+
+
+template <bool IgnoreSpaces, bool IgnoreCase>
+uint64_t hashLineAvx2(uint64_t seed, const unsigned char* text, intptr_t len)
+{
+	return hashLineWith<Avx2Kernel, IgnoreSpaces, IgnoreCase>(seed, text, len);
+}
+
+#else
+
+bool isAvx2KernelBuilt()
+{
+	return false;
+}
+
+
+template <bool IgnoreSpaces, bool IgnoreCase>
+uint64_t hashLineAvx2(uint64_t seed, const unsigned char* text, intptr_t len)
+{
+	return hashLineWith<ScalarKernel, IgnoreSpaces, IgnoreCase>(seed, text, len);
+}
+
+#endif // HASH_AVX2
+
+
+template uint64_t hashLineAvx2<false, false>(uint64_t seed, const unsigned char* text, intptr_t len);
+template uint64_t hashLineAvx2<true, false>(uint64_t seed, const unsigned char* text, intptr_t len);
+template uint64_t hashLineAvx2<false, true>(uint64_t seed, const unsigned char* text, intptr_t len);
+template uint64_t hashLineAvx2<true, true>(uint64_t seed, const unsigned char* text, intptr_t len);
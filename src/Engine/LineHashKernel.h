@@ -0,0 +1,291 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+
+// Line hash internals shared by the kernels' translation units (the AVX2 one is built with AVX2 code generation
+// enabled so everything here has internal linkage to keep the differently compiled copies apart).
+
+// The line is hashed as a stream of 32 bytes stripes (space and case filtered if needed) accumulated in 4 x 64-bit
+// lanes. Each lane adds the product of the low and high 32-bit halves of its keyed data word plus the neighbour
+// lane's raw data word (the scheme of XXH3). Each stripe between two scrambles is keyed by the key words starting
+// at its index (as XXH3 walks its secret) so swapped stripes hash differently. The same math maps directly to SSE2
+// (2 lanes per register) and AVX2 (4 lanes) so all kernels give identical hashes.
+
+namespace {
+
+const uint64_t cPrime1		= 0x9E3779B185EBCA87ULL;
+const uint64_t cPrime2		= 0xC2B2AE3D27D4EB4FULL;
+const uint64_t cPrime3		= 0x165667B19E3779F9ULL;
+const uint64_t cPrime32		= 0x9E3779B1ULL;
+
+const intptr_t cStripeLen			= 32;
+const intptr_t cStripesPerScramble	= 16;
+
+// Stripe s (counted from the last scramble) uses the words [s, s + 4) - the first 4 key the scramble too
+alignas(32) const uint64_t cKey[cStripesPerScramble + 3] = {
+	0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL, 0xDB979083E96DD4DEULL, 0x1F67B3B7A4A44072ULL,
+	0x950E87D7F5606615ULL, 0x2C61275C9E6B6CF8ULL, 0x1F00BCA0042DB923ULL, 0x6DBCA290A9EAB706ULL,
+	0x4C10A4FE30CFFDDAULL, 0xF26FFF4CC4FD394DULL, 0x6814A2BC786A6D2DULL, 0xA26B351E6C8042C5ULL,
+	0x54760E7FBC051C6CULL, 0xD4C08880A5A4666DULL, 0x29610AE0EED8F1E7ULL, 0xC34BD8E2FE5213E5ULL,
+	0x6C50AFB6E9FB123DULL, 0x6F28D015A2AA0B9DULL, 0x4E385994EBAC94AFULL
+};
+
+
+struct HashState
+{
+	HashState(uint64_t seed)
+	{
+		acc[0] = seed ^ cPrime1;
+		acc[1] = seed ^ cPrime2;
+		acc[2] = seed ^ cPrime3;
+		acc[3] = seed ^ cPrime32;
+	}
+
+	alignas(32) uint64_t acc[4];
+
+	// Filtered bytes waiting for a full stripe - up to 31 pending + 32 just filtered
+	alignas(32) unsigned char buf[2 * cStripeLen];
+
+	intptr_t bufLen {0};
+	intptr_t totalLen {0};
+	intptr_t stripes {0};
+};
+
+
+inline uint64_t read64(const unsigned char* p)
+{
+	uint64_t val;
+	std::memcpy(&val, p, sizeof(val));
+
+	return val;
+}
+
+
+inline bool isFoldable(unsigned char ch)
+{
+	return (static_cast<unsigned char>(ch - 'A') < 26);
+}
+
+
+inline bool isSpace(unsigned char ch)
+{
+	return (ch == ' ' || ch == '\t');
+}
+
+
+// Removes in-place the bytes marked in mask and returns the count of the remaining ones
+inline intptr_t compact(unsigned char* bytes, uint32_t mask, intptr_t count)
+{
+	if (mask == 0)
+		return count;
+
+	intptr_t n = 0;
+
+	for (intptr_t group = 0; group < count; group += 8)
+	{
+		const uint32_t groupMask = (mask >> group) & 0xFF;
+
+		if (groupMask == 0)
+		{
+			const uint64_t groupBytes = read64(bytes + group);
+			std::memcpy(bytes + n, &groupBytes, sizeof(groupBytes));
+			n += 8;
+		}
+		else if (groupMask != 0xFF)
+		{
+			for (intptr_t i = group; i < group + 8; ++i)
+			{
+				bytes[n] = bytes[i];
+				n += ((mask >> i) & 1) ^ 1;
+			}
+		}
+	}
+
+	return n;
+}
+
+
+inline void scramble(HashState& state)
+{
+	for (int i = 0; i < 4; ++i)
+		state.acc[i] = (state.acc[i] ^ (state.acc[i] >> 47) ^ cKey[i]) * cPrime32;
+}
+
+
+inline uint64_t finalize(const HashState& state, uint64_t seed)
+{
+	uint64_t h = seed + static_cast<uint64_t>(state.totalLen) * cPrime1;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		h ^= state.acc[i] * cPrime2;
+		h = ((h << 31) | (h >> 33)) * cPrime1;
+	}
+
+	h ^= h >> 33;
+	h *= cPrime2;
+	h ^= h >> 29;
+	h *= cPrime3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+
+struct ScalarKernel
+{
+	static inline void accumulate(uint64_t* acc, const unsigned char* stripe, const uint64_t* stripeKey)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			const uint64_t data	= read64(stripe + 8 * i);
+			const uint64_t key	= data ^ stripeKey[i];
+
+			acc[i ^ 1]	+= data;
+			acc[i]		+= (key & 0xFFFFFFFF) * (key >> 32);
+		}
+	}
+
+	// Filters stripe into dst and returns the count of the bytes left
+	template <bool IgnoreSpaces, bool IgnoreCase>
+	static inline intptr_t filter(const unsigned char* stripe, unsigned char* dst)
+	{
+		intptr_t n = 0;
+
+		for (intptr_t i = 0; i < cStripeLen; ++i)
+		{
+			unsigned char ch = stripe[i];
+
+			if (IgnoreCase && isFoldable(ch))
+				ch += 'a' - 'A';
+
+			dst[n] = ch;
+			n += !(IgnoreSpaces && isSpace(ch));
+		}
+
+		return n;
+	}
+};
+
+
+template <typename Kernel>
+inline void consume(HashState& state, const unsigned char* stripe)
+{
+	Kernel::accumulate(state.acc, stripe, cKey + state.stripes);
+
+	if (++state.stripes == cStripesPerScramble)
+	{
+		scramble(state);
+		state.stripes = 0;
+	}
+}
+
+
+// Hashes the buffered filtered bytes once they fill a whole stripe
+template <typename Kernel>
+inline void consumeBuffered(HashState& state)
+{
+	if (state.bufLen >= cStripeLen)
+	{
+		consume<Kernel>(state, state.buf);
+
+		state.bufLen -= cStripeLen;
+		std::memcpy(state.buf, state.buf + cStripeLen, state.bufLen);
+	}
+}
+
+
+// The filter flags are template parameters so each of the 4 variants gets its own branch free loop
+template <typename Kernel, bool IgnoreSpaces, bool IgnoreCase>
+inline uint64_t hashLineWith(uint64_t seed, const unsigned char* text, intptr_t len)
+{
+	HashState state(seed);
+
+	intptr_t pos = 0;
+
+	if (!IgnoreSpaces && !IgnoreCase)
+	{
+		for (; pos + cStripeLen <= len; pos += cStripeLen)
+			consume<Kernel>(state, text + pos);
+
+		state.totalLen = pos;
+	}
+	else
+	{
+		for (; pos + cStripeLen <= len; pos += cStripeLen)
+		{
+			const intptr_t n = Kernel::template filter<IgnoreSpaces, IgnoreCase>(text + pos, state.buf + state.bufLen);
+
+			state.bufLen	+= n;
+			state.totalLen	+= n;
+
+			consumeBuffered<Kernel>(state);
+		}
+	}
+
+	const intptr_t tailLen = len - pos;
+
+	if (tailLen)
+	{
+		intptr_t n = tailLen;
+
+		if (!IgnoreSpaces && !IgnoreCase)
+		{
+			std::memcpy(state.buf + state.bufLen, text + pos, tailLen);
+		}
+		else
+		{
+			// Zero padding is never filtered out and stays at the end
+			alignas(32) unsigned char tail[cStripeLen] = {};
+			std::memcpy(tail, text + pos, tailLen);
+
+			n = Kernel::template filter<IgnoreSpaces, IgnoreCase>(tail, state.buf + state.bufLen) -
+					(cStripeLen - tailLen);
+		}
+
+		state.bufLen	+= n;
+		state.totalLen	+= n;
+	}
+
+	consumeBuffered<Kernel>(state);
+
+	if (state.totalLen == 0)
+		return seed;
+
+	if (state.bufLen)
+	{
+		std::memset(state.buf + state.bufLen, 0, cStripeLen - state.bufLen);
+		consume<Kernel>(state, state.buf);
+	}
+
+	return finalize(state, seed);
+}
+
+
+}
+
+
+bool isAvx2KernelBuilt();
+
+template <bool IgnoreSpaces, bool IgnoreCase>
+uint64_t hashLineAvx2(uint64_t seed, const unsigned char* text, intptr_t len);
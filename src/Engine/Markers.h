@@ -0,0 +1,77 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+enum Marker_t
+{
+	MARKER_CHANGED_LINE = 0,
+	MARKER_ADDED_LINE,
+	MARKER_REMOVED_LINE,
+	MARKER_MOVED_LINE,
+	MARKER_BLANK,
+	MARKER_CHANGED_SYMBOL,
+	MARKER_CHANGED_LOCAL_SYMBOL,
+	MARKER_ADDED_SYMBOL,
+	MARKER_ADDED_LOCAL_SYMBOL,
+	MARKER_REMOVED_SYMBOL,
+	MARKER_REMOVED_LOCAL_SYMBOL,
+	MARKER_MOVED_LINE_SYMBOL,
+	MARKER_MOVED_BLOCK_BEGIN_SYMBOL,
+	MARKER_MOVED_BLOCK_MID_SYMBOL,
+	MARKER_MOVED_BLOCK_END_SYMBOL,
+	MARKER_ARROW_SYMBOL
+};
+
+
+constexpr int MARKER_MASK_CHANGED		=	(1 << MARKER_CHANGED_LINE)	|	(1 << MARKER_CHANGED_SYMBOL);
+constexpr int MARKER_MASK_CHANGED_LOCAL	=	(1 << MARKER_CHANGED_LINE)	|	(1 << MARKER_CHANGED_LOCAL_SYMBOL);
+constexpr int MARKER_MASK_ADDED			=	(1 << MARKER_ADDED_LINE)	|	(1 << MARKER_ADDED_SYMBOL);
+constexpr int MARKER_MASK_ADDED_LOCAL	=	(1 << MARKER_ADDED_LINE)	|	(1 << MARKER_ADDED_LOCAL_SYMBOL);
+constexpr int MARKER_MASK_REMOVED		=	(1 << MARKER_REMOVED_LINE)	|	(1 << MARKER_REMOVED_SYMBOL);
+constexpr int MARKER_MASK_REMOVED_LOCAL	=	(1 << MARKER_REMOVED_LINE)	|	(1 << MARKER_REMOVED_LOCAL_SYMBOL);
+constexpr int MARKER_MASK_MOVED_LINE	=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_LINE_SYMBOL);
+constexpr int MARKER_MASK_MOVED_BEGIN	=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_BLOCK_BEGIN_SYMBOL);
+constexpr int MARKER_MASK_MOVED_MID		=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_BLOCK_MID_SYMBOL);
+constexpr int MARKER_MASK_MOVED_END		=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_BLOCK_END_SYMBOL);
+constexpr int MARKER_MASK_MOVED			=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_LINE_SYMBOL) |
+																			(1 << MARKER_MOVED_BLOCK_BEGIN_SYMBOL) |
+																			(1 << MARKER_MOVED_BLOCK_MID_SYMBOL) |
+																			(1 << MARKER_MOVED_BLOCK_END_SYMBOL);
+
+constexpr int MARKER_MASK_BLANK			=	(1 << MARKER_BLANK);
+constexpr int MARKER_MASK_ARROW			=	(1 << MARKER_ARROW_SYMBOL);
+
+constexpr int MARKER_MASK_LINE			=	(1 << MARKER_CHANGED_LINE) |
+											(1 << MARKER_ADDED_LINE) |
+											(1 << MARKER_REMOVED_LINE) |
+											(1 << MARKER_MOVED_LINE);
+
+constexpr int MARKER_MASK_SYMBOL		=	(1 << MARKER_CHANGED_SYMBOL) |
+											(1 << MARKER_CHANGED_LOCAL_SYMBOL) |
+											(1 << MARKER_ADDED_SYMBOL) |
+											(1 << MARKER_ADDED_LOCAL_SYMBOL) |
+											(1 << MARKER_REMOVED_SYMBOL) |
+											(1 << MARKER_REMOVED_LOCAL_SYMBOL) |
+											(1 << MARKER_MOVED_LINE_SYMBOL) |
+											(1 << MARKER_MOVED_BLOCK_BEGIN_SYMBOL) |
+											(1 << MARKER_MOVED_BLOCK_MID_SYMBOL) |
+											(1 << MARKER_MOVED_BLOCK_END_SYMBOL);
+
+constexpr int MARKER_MASK_ALL			=	MARKER_MASK_LINE | MARKER_MASK_SYMBOL;
@@ -0,0 +1,182 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2011 Jean-Sebastien Leroy (jean.sebastien.leroy@gmail.com)
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <vector>
+
+#include <windows.h>
+
+#include "Compare.h"
+#include "NppHelpers.h"
+#include "NppEngine.h"
+#include "ProgressDlg.h"
+
+
+namespace {
+
+/**
+ *  \class  ScintillaDocument
+ *  \brief  Compare engine input taken from Notepad++ view
+ */
+class ScintillaDocument : public DocumentSource
+{
+public:
+	ScintillaDocument(int view) : _view(view) {}
+
+	// Moves the gap of Scintilla's buffer to the document end so the text is contiguous
+	virtual const char* text() const
+	{
+		return reinterpret_cast<const char*>(CallScintilla(_view, SCI_GETCHARACTERPOINTER, 0, 0));
+	}
+
+	virtual intptr_t length() const
+	{
+		return CallScintilla(_view, SCI_GETLENGTH, 0, 0);
+	}
+
+private:
+	const int _view;
+};
+
+
+/**
+ *  \class  ScintillaDiffSink
+ *  \brief  Marks compare engine results in Notepad++ views
+ */
+class ScintillaDiffSink : public DiffSink
+{
+public:
+	virtual void clear(int view)
+	{
+		clearWindow(view);
+	}
+
+	virtual void markLine(int view, intptr_t line, int markMask)
+	{
+		CallScintilla(view, SCI_MARKERADDSET, line, markMask);
+	}
+
+	virtual void markLineChanges(int view, intptr_t line, const std::vector<section_t>& changes, int blockDiffMask)
+	{
+		const intptr_t linePos = getLineStart(view, line);
+		const int color = (blockDiffMask == MARKER_MASK_ADDED) ?
+				Settings.colors().add_highlight : Settings.colors().rem_highlight;
+
+		for (const auto& change: changes)
+			markTextAsChanged(view, linePos + change.off, change.len, color);
+	}
+};
+
+
+/**
+ *  \class  ProgressDlgMonitor
+ *  \brief  Reports compare engine progress through the progress dialog
+ */
+class ProgressDlgMonitor : public CompareProgress
+{
+public:
+	ProgressDlgMonitor(ProgressDlg& dlg) : _dlg(dlg) {}
+
+	virtual void Show()
+	{
+		_dlg.Show();
+	}
+
+	virtual bool IsCancelled() const
+	{
+		return _dlg.IsCancelled();
+	}
+
+	virtual unsigned NextPhase()
+	{
+		return _dlg.NextPhase();
+	}
+
+	virtual bool SetMaxCount(intptr_t max)
+	{
+		return _dlg.SetMaxCount(max);
+	}
+
+	virtual bool Advance(intptr_t cnt = 1)
+	{
+		return _dlg.Advance(cnt);
+	}
+
+private:
+	ProgressDlg& _dlg;
+};
+
+}
+
+
+CompareResult compareViews(const CompareOptions& options, const TCHAR* progressInfo, CompareSummary& summary)
+{
+	CompareResult result = CompareResult::COMPARE_ERROR;
+
+	if (progressInfo)
+		ProgressDlg::Open(progressInfo);
+
+	try
+	{
+		ScintillaDocument mainDoc(MAIN_VIEW);
+		ScintillaDocument subDoc(SUB_VIEW);
+
+		ScintillaDiffSink sink;
+
+		std::unique_ptr<ProgressDlgMonitor> progress;
+
+		if (ProgressDlg::Get())
+			progress.reset(new ProgressDlgMonitor(*ProgressDlg::Get()));
+
+		if (options.findUniqueMode)
+			result = runFindUnique(mainDoc, subDoc, sink, options, summary, progress.get());
+		else
+			result = runCompare(mainDoc, subDoc, sink, options, summary, progress.get());
+
+		progress.reset();
+		ProgressDlg::Close();
+
+		if (result != CompareResult::COMPARE_MISMATCH)
+		{
+			clearWindow(MAIN_VIEW);
+			clearWindow(SUB_VIEW);
+		}
+	}
+	catch (std::exception& e)
+	{
+		ProgressDlg::Close();
+
+		clearWindow(MAIN_VIEW);
+		clearWindow(SUB_VIEW);
+
+		char msg[128];
+		_snprintf_s(msg, _countof(msg), _TRUNCATE, "Exception occurred: %s", e.what());
+		::MessageBoxA(nppData._nppHandle, msg, "ComparePlus", MB_OK | MB_ICONWARNING);
+	}
+	catch (...)
+	{
+		ProgressDlg::Close();
+
+		::MessageBoxA(nppData._nppHandle, "Unknown exception occurred.", "ComparePlus", MB_OK | MB_ICONWARNING);
+	}
+
+	return result;
+}
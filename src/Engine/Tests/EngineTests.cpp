@@ -0,0 +1,1226 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Headless compare engine tests (run by ctest) - checks that the line hash kernels agree and keep the stripes order,
+// that DiffCalc's edit scripts rebuild both sequences, are minimal where they must be and the same as the baseline
+// DiffCalc's (see BaselineDiff.h) where they must not change, that the parallel paths give the single threaded
+// results and the thread pool's loops.
+// Prints the failed checks and exits with non-zero status if there are any:
+//
+//   EngineTests
+
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "diff.h"
+#include "BaselineDiff.h"
+#include "Engine.h"
+#include "LineHash.h"
+#include "ThreadPool.h"
+
+
+namespace {
+
+int failedChecks = 0;
+
+#define CHECK(cond) \
+	do \
+	{ \
+		if (!(cond)) \
+		{ \
+			++failedChecks; \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		} \
+	} while (0)
+
+
+// The worker threads the parallel tests run on (besides the calling one) - the host might have a single core
+const int cTestWorkers = 3;
+
+
+using Ids = std::vector<uint32_t>;
+
+
+// Longest common subsequence length (dynamic programming) - the matches count of a minimal script
+template <typename Elem>
+intptr_t lcsLength(const std::vector<Elem>& a, const std::vector<Elem>& b)
+{
+	std::vector<intptr_t> prevRow(b.size() + 1);
+	std::vector<intptr_t> row(b.size() + 1);
+
+	for (size_t i = 1; i <= a.size(); ++i)
+	{
+		for (size_t j = 1; j <= b.size(); ++j)
+			row[j] = (a[i - 1] == b[j - 1]) ? prevRow[j - 1] + 1 : std::max(prevRow[j], row[j - 1]);
+
+		row.swap(prevRow);
+	}
+
+	return prevRow[b.size()];
+}
+
+
+// Checks that the edit script rebuilds both sequences - its matches and DIFF_IN_1 parts give the first one and its
+// matches and DIFF_IN_2 parts the second one (b first if swapped). Returns the matches count or -1 if not valid
+template <typename Elem, typename UserDataT>
+intptr_t scriptMatches(const std::vector<Elem>& a, const std::vector<Elem>& b,
+		const std::vector<diff_info<UserDataT>>& diff, bool swapped)
+{
+	const std::vector<Elem>& seq1 = swapped ? b : a;
+	const std::vector<Elem>& seq2 = swapped ? a : b;
+
+	const intptr_t size1 = static_cast<intptr_t>(seq1.size());
+	const intptr_t size2 = static_cast<intptr_t>(seq2.size());
+
+	intptr_t off1		= 0;
+	intptr_t off2		= 0;
+	intptr_t matches	= 0;
+
+	for (const auto& d: diff)
+	{
+		if (d.len <= 0)
+			return -1;
+
+		if (d.type == diff_type::DIFF_MATCH)
+		{
+			if (d.off != off1 || off1 + d.len > size1 || off2 + d.len > size2 ||
+					!std::equal(seq1.begin() + off1, seq1.begin() + off1 + d.len, seq2.begin() + off2))
+				return -1;
+
+			off1	+= d.len;
+			off2	+= d.len;
+			matches	+= d.len;
+		}
+		else if (d.type == diff_type::DIFF_IN_1)
+		{
+			if (d.off != off1 || off1 + d.len > size1)
+				return -1;
+
+			off1 += d.len;
+		}
+		else
+		{
+			if (d.off != off2 || off2 + d.len > size2)
+				return -1;
+
+			off2 += d.len;
+		}
+	}
+
+	return (off1 == size1 && off2 == size2) ? matches : -1;
+}
+
+
+template <typename UserDataT>
+bool isSameScript(const std::vector<diff_info<UserDataT>>& diff1, const std::vector<diff_info<UserDataT>>& diff2)
+{
+	if (diff1.size() != diff2.size())
+		return false;
+
+	for (size_t i = 0; i < diff1.size(); ++i)
+	{
+		if (diff1[i].type != diff2[i].type || diff1[i].off != diff2[i].off || diff1[i].len != diff2[i].len)
+			return false;
+	}
+
+	return true;
+}
+
+
+// True if the compare result is the same as the baseline DiffCalc's
+template <typename Elem, typename UserDataT>
+bool isBaselineResult(const std::vector<Elem>& a, const std::vector<Elem>& b, bool doCombine, bool doShift,
+		const std::pair<std::vector<diff_info<UserDataT>>, bool>& res)
+{
+	const auto baselineRes = BaselineDiffCalc<Elem, UserDataT>(a, b)(doCombine, doShift);
+
+	return (res.second == baselineRes.second && isSameScript(res.first, baselineRes.first));
+}
+
+
+// A random sequence over a small alphabet and a second one - unrelated, an edited copy or of the same size
+void randomPair(std::mt19937& rng, intptr_t maxSize, Ids& a, Ids& b)
+{
+	const uint32_t alphabet = 1 + rng() % 8;
+
+	a.resize(rng() % (maxSize + 1));
+
+	for (auto& id: a)
+		id = rng() % alphabet;
+
+	switch (rng() % 3)
+	{
+		case 0:
+			b.resize(rng() % (maxSize + 1));
+
+			for (auto& id: b)
+				id = rng() % alphabet;
+		break;
+
+		case 1:
+		{
+			b = a;
+
+			for (int edits = rng() % 6; edits; --edits)
+			{
+				const int op = rng() % 3;
+
+				if (op == 0 && !b.empty())
+					b.erase(b.begin() + rng() % b.size());
+				else if (op == 1)
+					b.insert(b.begin() + rng() % (b.size() + 1), rng() % (alphabet + 2));
+				else if (!b.empty())
+					b[rng() % b.size()] = rng() % (alphabet + 2);
+			}
+		}
+		break;
+
+		default:
+			b = a;
+
+			if (!b.empty())
+				b[rng() % b.size()] ^= 7;
+	}
+
+	// Equal sizes are compared both ways
+	if (rng() % 4 == 0)
+	{
+		b.resize(a.size());
+
+		for (auto& id: b)
+		{
+			if (rng() % 3 == 0)
+				id = rng() % alphabet;
+		}
+	}
+}
+
+
+// Big sequences of mostly unique IDs (as code lines) with a change every few elements
+void bigPair(std::mt19937& rng, intptr_t size, intptr_t changeEvery, bool sameSize, Ids& a, Ids& b)
+{
+	uint32_t uniqueId = 16;
+
+	auto newId = [&]() { return (rng() % 4) ? uniqueId++ : static_cast<uint32_t>(rng() % 16); };
+
+	a.resize(size);
+
+	for (auto& id: a)
+		id = newId();
+
+	b.clear();
+
+	for (intptr_t i = 0; i < size; ++i)
+	{
+		if (rng() % changeEvery)
+		{
+			b.push_back(a[i]);
+			continue;
+		}
+
+		const int op = sameSize ? 2 : rng() % 3;
+
+		if (op == 1)
+		{
+			b.push_back(newId());
+			b.push_back(a[i]);
+		}
+		else if (op == 2)
+		{
+			b.push_back(newId());
+		}
+	}
+}
+
+
+void testLineHash()
+{
+	const HashKernel kernels[] = { HashKernel::SCALAR, HashKernel::SSE2, HashKernel::AVX2 };
+
+	// The same 32 bytes stripes in swapped order
+	const std::string stripe1(32, 'a');
+	const std::string stripe2 = "int x = compute(foo, bar, baz);;";
+
+	const std::string line1 = stripe1 + stripe2;
+	const std::string line2 = stripe2 + stripe1;
+
+	// Lines of many stripes with two of them swapped
+	std::mt19937 rng(13579);
+	std::string longLine1;
+
+	for (int i = 0; i < 40 * 32; ++i)
+		longLine1 += static_cast<char>('a' + rng() % 26);
+
+	std::string longLine2 = longLine1;
+	std::swap_ranges(longLine2.begin() + 3 * 32, longLine2.begin() + 4 * 32, longLine2.begin() + 9 * 32);
+
+	for (int flags = 0; flags < 4; ++flags)
+	{
+		const bool ignoreSpaces	= (flags & 1);
+		const bool ignoreCase	= (flags & 2);
+
+		const uint64_t scalarHash = hashLine(HashKernel::SCALAR, cHashSeed, longLine1.data(),
+				static_cast<intptr_t>(longLine1.size()), ignoreSpaces, ignoreCase);
+
+		for (HashKernel kernel: kernels)
+		{
+			if (!isHashKernelSupported(kernel))
+				continue;
+
+			CHECK(hashLine(kernel, cHashSeed, line1.data(), static_cast<intptr_t>(line1.size()),
+					ignoreSpaces, ignoreCase) !=
+					hashLine(kernel, cHashSeed, line2.data(), static_cast<intptr_t>(line2.size()),
+					ignoreSpaces, ignoreCase));
+
+			const uint64_t hash = hashLine(kernel, cHashSeed, longLine1.data(),
+					static_cast<intptr_t>(longLine1.size()), ignoreSpaces, ignoreCase);
+
+			CHECK(hash == scalarHash);
+			CHECK(hash != hashLine(kernel, cHashSeed, longLine2.data(), static_cast<intptr_t>(longLine2.size()),
+					ignoreSpaces, ignoreCase));
+		}
+	}
+}
+
+
+void testMyersScripts()
+{
+	std::mt19937 rng(12345);
+
+	Ids a;
+	Ids b;
+
+	for (int i = 0; i < 3000; ++i)
+	{
+		randomPair(rng, 60, a, b);
+
+		const intptr_t lcs = lcsLength(a, b);
+
+		for (int flags = 0; flags < 8; ++flags)
+		{
+			const bool doCombine	= (flags & 1);
+			const bool doShift		= (flags & 2);
+			const bool doDiscard	= (flags & 4);
+
+			const auto res = DiffCalc<uint32_t>(a, b)(doCombine, doShift, doDiscard);
+
+			CHECK(scriptMatches(a, b, res.first, res.second) == lcs);
+
+			// Discarding can pair the elements up differently
+			if (!doDiscard)
+				CHECK(isBaselineResult(a, b, doCombine, doShift, res));
+
+			DiffCalc<uint32_t> singleCalc(a, b);
+			singleCalc.set_orientation(diff_orientation::SINGLE);
+
+			const auto singleRes = singleCalc(doCombine, doShift, doDiscard);
+
+			CHECK(scriptMatches(a, b, singleRes.first, singleRes.second) == lcs);
+		}
+
+		// Not dense IDs - nothing is discarded
+		const std::vector<int> ia(a.begin(), a.end());
+		const std::vector<int> ib(b.begin(), b.end());
+
+		const auto res = DiffCalc<int>(ia, ib)(true, true, true);
+
+		CHECK(scriptMatches(ia, ib, res.first, res.second) == lcs);
+		CHECK(isBaselineResult(ia, ib, true, true, res));
+	}
+
+	// Discarding 10, 11 and 12 to 14 leaves a single match to pair differently
+	a = { 10, 11, 0 };
+	b = { 0, 0, 12, 13, 14 };
+
+	const auto res = DiffCalc<uint32_t>(a, b)(false, false, false);
+	const auto discardingRes = DiffCalc<uint32_t>(a, b)(false, false, true);
+
+	CHECK(isBaselineResult(a, b, false, false, res));
+	CHECK(!isSameScript(res.first, discardingRes.first));
+	CHECK(scriptMatches(a, b, discardingRes.first, discardingRes.second) == 1);
+
+	// The same lines deep in a big file - their IDs are too big to be taken as dense unless the classes count is given
+	const uint32_t cBigId = 1 << 20;
+
+	for (auto& id: a)
+		id += cBigId;
+
+	for (auto& id: b)
+		id += cBigId;
+
+	CHECK(isSameScript(DiffCalc<uint32_t>(a, b)(false, false, true).first, res.first));
+
+	DiffCalc<uint32_t> countedCalc(a, b);
+	countedCalc.set_classes_count(cBigId + 15);
+
+	CHECK(isSameScript(countedCalc(false, false, true).first, discardingRes.first));
+}
+
+
+void testSuffixTrim()
+{
+	// Line IDs of a C-like text - blank lines and closing braces are repeated all over
+	const uint32_t cBlank	= 0;
+	const uint32_t cClose	= 1;
+	const uint32_t cOpen	= 2;
+
+	Ids tail;
+
+	for (uint32_t i = 0; i < 10; ++i)
+	{
+		tail.push_back(cClose);
+		tail.push_back(cBlank);
+	}
+
+	for (uint32_t i = 0; i < 300; ++i)
+	{
+		tail.push_back(100 + i);
+		tail.push_back(cOpen);
+		tail.push_back(1000 + i);
+		tail.push_back(cClose);
+		tail.push_back(cBlank);
+	}
+
+	// Two functions changed near the top - the common suffix begins with lines found in the changed part
+	Ids a = { 10, cOpen, 11, cClose, cBlank, 12, cOpen, 13, cClose, cBlank };
+	Ids b = { 10, cOpen, 21, cClose, cBlank, 12, cOpen, 23, cClose, cBlank };
+
+	a.insert(a.end(), tail.begin(), tail.end());
+	b.insert(b.end(), tail.begin(), tail.end());
+
+	// The suffix begins with a line also removed before it - the search could match it there
+	Ids c = { 10, 5, cClose };
+	Ids d = { 10 };
+
+	c.insert(c.end(), tail.begin(), tail.end());
+	d.insert(d.end(), tail.begin(), tail.end());
+
+	// The untrimmed search matches the suffix's first element before it although no change slides into it
+	const Ids e = { 1, 0, 0 };
+	const Ids f = { 0, 0, 0, 1, 1, 1, 1, 0 };
+	const Ids g = { 1, 1 };
+	const Ids h = { 0, 1, 0, 1, 0, 1, 0, 1 };
+
+	const intptr_t lcs = lcsLength(a, b);
+	const intptr_t lcsTied = lcsLength(c, d);
+
+	for (int flags = 0; flags < 16; ++flags)
+	{
+		const bool doCombine	= (flags & 1);
+		const bool doShift		= (flags & 2);
+		const bool doDiscard	= (flags & 4);
+		const bool doSwap		= (flags & 8);
+
+		const Ids& a1 = doSwap ? b : a;
+		const Ids& b1 = doSwap ? a : b;
+
+		const auto res = DiffCalc<uint32_t>(a1, b1)(doCombine, doShift, doDiscard);
+
+		CHECK(scriptMatches(a1, b1, res.first, res.second) == lcs);
+
+		const Ids& c1 = doSwap ? d : c;
+		const Ids& d1 = doSwap ? c : d;
+
+		const auto tiedRes = DiffCalc<uint32_t>(c1, d1)(doCombine, doShift, doDiscard);
+
+		CHECK(scriptMatches(c1, d1, tiedRes.first, tiedRes.second) == lcsTied);
+
+		// The suffix is trimmed without changing the script
+		if (!doDiscard)
+		{
+			CHECK(isBaselineResult(a1, b1, doCombine, doShift, res));
+			CHECK(isBaselineResult(c1, d1, doCombine, doShift, tiedRes));
+			CHECK(isBaselineResult(e, f, doCombine, doShift, DiffCalc<uint32_t>(e, f)(doCombine, doShift)));
+			CHECK(isBaselineResult(g, h, doCombine, doShift, DiffCalc<uint32_t>(g, h)(doCombine, doShift)));
+		}
+	}
+
+	// Random pairs with a long common prefix or suffix of few distinct elements
+	std::mt19937 rng(34567);
+
+	for (int i = 0; i < 2000; ++i)
+	{
+		randomPair(rng, 40, a, b);
+
+		const bool commonPrefix = (i & 1);
+
+		for (uint32_t j = 0; j < 40; ++j)
+		{
+			const uint32_t id = rng() % 4;
+
+			a.insert(commonPrefix ? a.begin() : a.end(), id);
+			b.insert(commonPrefix ? b.begin() : b.end(), id);
+		}
+
+		for (int flags = 0; flags < 4; ++flags)
+			CHECK(isBaselineResult(a, b, (flags & 1), (flags & 2), DiffCalc<uint32_t>(a, b)((flags & 1), (flags & 2))));
+	}
+}
+
+
+void testHistogramScripts()
+{
+	std::mt19937 rng(23456);
+
+	Ids a;
+	Ids b;
+
+	for (int i = 0; i < 3000; ++i)
+	{
+		randomPair(rng, 100, a, b);
+
+		const intptr_t lcs = lcsLength(a, b);
+
+		for (int flags = 0; flags < 4; ++flags)
+		{
+			const auto res = DiffCalc<uint32_t>(a, b)((flags & 1), (flags & 2), false, diff_algorithm::HISTOGRAM);
+
+			const intptr_t matches = scriptMatches(a, b, res.first, res.second);
+
+			CHECK(matches >= 0);
+			CHECK(matches <= lcs);
+		}
+	}
+
+	bigPair(rng, 20000, 10, false, a, b);
+
+	const auto res = DiffCalc<uint32_t>(a, b)(true, true, false, diff_algorithm::HISTOGRAM);
+
+	CHECK(scriptMatches(a, b, res.first, res.second) >= 0);
+}
+
+
+void testBoundedCost()
+{
+	std::mt19937 rng(45678);
+
+	Ids a;
+	Ids b;
+
+	// The cost bound is never hit by small sequences
+	for (int i = 0; i < 1000; ++i)
+	{
+		randomPair(rng, 60, a, b);
+
+		DiffCalc<uint32_t> diffCalc(a, b);
+		diffCalc.set_bounded_cost(true);
+
+		const auto res = diffCalc(true, true);
+
+		CHECK(!diffCalc.approximate());
+		CHECK(scriptMatches(a, b, res.first, res.second) == lcsLength(a, b));
+	}
+
+	// Very different sequences - the script is valid but might not be minimal
+	a.resize(20000);
+	b.resize(20000);
+
+	for (auto& id: a)
+		id = rng() % 2000;
+
+	for (auto& id: b)
+		id = rng() % 2000;
+
+	DiffCalc<uint32_t> diffCalc(a, b);
+	diffCalc.set_bounded_cost(true);
+
+	const auto res = diffCalc(true, true);
+
+	CHECK(diffCalc.approximate());
+	CHECK(scriptMatches(a, b, res.first, res.second) >= 0);
+
+	// Still very different but smaller
+	const Ids c(a.begin(), a.begin() + 6000);
+	const Ids d(b.begin(), b.begin() + 6000);
+
+	// Unbounded (minimal lines diff) - the script is minimal
+	DiffCalc<uint32_t> minimalCalc(c, d);
+	minimalCalc.set_bounded_cost(false);
+
+	const auto minimalRes = minimalCalc(true, true);
+
+	CHECK(!minimalCalc.approximate());
+	CHECK(scriptMatches(c, d, minimalRes.first, minimalRes.second) == lcsLength(c, d));
+
+	// Only the kept orientation's flag is reported - the same as when it is compared alone
+	Ids e;
+	Ids f;
+
+	bigPair(rng, 6000, 20, true, e, f);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		const Ids& a1 = (i & 1) ? e : c;
+		const Ids& b1 = (i & 1) ? f : d;
+
+		DiffCalc<uint32_t> bothCalc(a1, b1);
+		bothCalc.set_bounded_cost(true);
+		bothCalc.set_orientation((i & 2) ?
+				diff_orientation::CHECK_BOTH_CONCURRENTLY : diff_orientation::CHECK_BOTH);
+
+		const auto bothRes = bothCalc(true, true);
+
+		DiffCalc<uint32_t> singleCalc(bothRes.second ? b1 : a1, bothRes.second ? a1 : b1);
+		singleCalc.set_bounded_cost(true);
+		singleCalc.set_orientation(diff_orientation::SINGLE);
+
+		const auto singleRes = singleCalc(true, true);
+
+		CHECK(!singleRes.second);
+		CHECK(bothCalc.approximate() == singleCalc.approximate());
+		CHECK(bothCalc.approximate() == !(i & 1));
+		CHECK(isSameScript(bothRes.first, singleRes.first));
+	}
+}
+
+
+void testMaxDistance()
+{
+	std::mt19937 rng(78901);
+
+	Ids a;
+	Ids b;
+
+	// No differences once the edit distance reaches max - below it the script is the unlimited one
+	for (int i = 0; i < 2000; ++i)
+	{
+		randomPair(rng, 60, a, b);
+
+		const intptr_t dist = static_cast<intptr_t>(a.size() + b.size()) - 2 * lcsLength(a, b);
+
+		if (dist == 0)
+			continue;
+
+		const auto unlimitedRes = DiffCalc<uint32_t>(a, b)();
+
+		for (intptr_t max: { dist + 1, dist, dist / 2 + 1 })
+		{
+			const auto res = DiffCalc<uint32_t>(a, b, max)();
+
+			if (max > dist)
+				CHECK(res.second == unlimitedRes.second && isSameScript(res.first, unlimitedRes.first));
+			else
+				CHECK(res.first.empty());
+		}
+	}
+
+	// Many split levels
+	for (int i = 0; i < 4; ++i)
+	{
+		bigPair(rng, 3000, 10, (i & 1), a, b);
+
+		const intptr_t dist = static_cast<intptr_t>(a.size() + b.size()) - 2 * lcsLength(a, b);
+		const auto unlimitedRes = DiffCalc<uint32_t>(a, b)();
+
+		CHECK(isSameScript(DiffCalc<uint32_t>(a, b, dist + 1)().first, unlimitedRes.first));
+		CHECK(DiffCalc<uint32_t>(a, b, dist)().first.empty());
+		CHECK(DiffCalc<uint32_t>(a, b, 64)().first.empty());
+	}
+}
+
+
+void testVisit()
+{
+	std::mt19937 rng(56789);
+
+	Ids a;
+	Ids b;
+
+	for (int i = 0; i < 1000; ++i)
+	{
+		randomPair(rng, 60, a, b);
+
+		std::vector<diff_info<void>> visited;
+		bool visitedSwapped = false;
+
+		const bool swapped = DiffCalc<uint32_t>(a, b).visit(
+			[&](const diff_info<void>& d, bool s)
+			{
+				visited.push_back(d);
+				visitedSwapped = s;
+			}, true, true);
+
+		const auto res = DiffCalc<uint32_t>(a, b)(true, true);
+
+		CHECK(swapped == res.second);
+		CHECK(visited.empty() || visitedSwapped == swapped);
+		CHECK(isSameScript(visited, res.first));
+	}
+}
+
+
+// Runs the tasks as jobs of the thread pool (as the engine does)
+void runPoolTasks(int tasksCount, const std::function<void(int)>& task)
+{
+	ThreadPool::parallelFor(tasksCount, tasksCount, [&task](intptr_t job, int) { task(static_cast<int>(job)); });
+}
+
+
+void testParallelDiff()
+{
+	ThreadPool::setWorkersCount(cTestWorkers);
+
+	std::mt19937 rng(67890);
+
+	Ids a;
+	Ids b;
+
+	for (int i = 0; i < 8; ++i)
+	{
+		const bool sameSize = (i & 1);
+		const bool doDiscard = (i & 2);
+
+		bigPair(rng, 6000, 20, sameSize, a, b);
+
+		const auto serialRes = DiffCalc<uint32_t>(a, b)(true, true, doDiscard);
+
+		CHECK(scriptMatches(a, b, serialRes.first, serialRes.second) >= 0);
+
+		// The baseline script - the parallel ones below must be the same
+		if (!doDiscard)
+			CHECK(isBaselineResult(a, b, true, true, serialRes));
+
+		// Own threads
+		{
+			DiffCalc<uint32_t> diffCalc(a, b);
+			diffCalc.set_parallel(cTestWorkers + 1);
+			diffCalc.set_orientation(diff_orientation::CHECK_BOTH_CONCURRENTLY);
+
+			const auto res = diffCalc(true, true, doDiscard);
+
+			CHECK(res.second == serialRes.second);
+			CHECK(isSameScript(res.first, serialRes.first));
+		}
+
+		// Pool threads
+		{
+			DiffCalc<uint32_t> diffCalc(a, b);
+			diffCalc.set_parallel(cTestWorkers + 1);
+			diffCalc.set_tasks_runner(runPoolTasks);
+			diffCalc.set_orientation(diff_orientation::CHECK_BOTH_CONCURRENTLY);
+
+			const auto res = diffCalc(true, true, doDiscard);
+
+			CHECK(res.second == serialRes.second);
+			CHECK(isSameScript(res.first, serialRes.first));
+		}
+
+		// Several compares at the same time
+		ThreadPool::parallelFor(4, 4,
+			[&](intptr_t, int)
+			{
+				DiffCalc<uint32_t> diffCalc(a, b);
+				diffCalc.set_parallel(cTestWorkers + 1);
+				diffCalc.set_tasks_runner(runPoolTasks);
+
+				const auto res = diffCalc(true, true, doDiscard);
+
+				CHECK(isSameScript(res.first, serialRes.first));
+			});
+	}
+
+	// Both orientations of equal sized sequences compared concurrently - the baseline's script and swap flag
+	for (int i = 0; i < 500; ++i)
+	{
+		randomPair(rng, 60, a, b);
+
+		b.resize(a.size());
+
+		for (int flags = 0; flags < 4; ++flags)
+		{
+			DiffCalc<uint32_t> diffCalc(a, b);
+			diffCalc.set_orientation(diff_orientation::CHECK_BOTH_CONCURRENTLY);
+
+			if (i & 1)
+				diffCalc.set_tasks_runner(runPoolTasks);
+
+			CHECK(isBaselineResult(a, b, (flags & 1), (flags & 2), diffCalc((flags & 1), (flags & 2))));
+		}
+	}
+
+	// Parallel splits of minimal scripts are minimal too - the same as the baseline's
+	bigPair(rng, 3000, 10, false, a, b);
+
+	const intptr_t lcs = lcsLength(a, b);
+
+	for (int flags = 0; flags < 4; ++flags)
+	{
+		DiffCalc<uint32_t> diffCalc(a, b);
+		diffCalc.set_parallel(cTestWorkers + 1);
+		diffCalc.set_tasks_runner(runPoolTasks);
+
+		const auto res = diffCalc((flags & 1), (flags & 2));
+
+		CHECK(scriptMatches(a, b, res.first, res.second) == lcs);
+		CHECK(isBaselineResult(a, b, (flags & 1), (flags & 2), res));
+	}
+
+	// Limited edit distance - the baseline's script below the limit and no differences from it on
+	const intptr_t dist = static_cast<intptr_t>(a.size() + b.size()) - 2 * lcs;
+
+	for (intptr_t max: { dist + 1, dist, dist / 2 })
+	{
+		DiffCalc<uint32_t> diffCalc(a, b, max);
+		diffCalc.set_parallel(cTestWorkers + 1);
+		diffCalc.set_tasks_runner(runPoolTasks);
+
+		const auto res = diffCalc(true, true);
+
+		if (max > dist)
+			CHECK(isBaselineResult(a, b, true, true, res));
+		else
+			CHECK(res.first.empty());
+	}
+}
+
+
+void testThreadPool()
+{
+	ThreadPool::setWorkersCount(cTestWorkers);
+
+	CHECK(ThreadPool::workersCount() == cTestWorkers);
+
+	// Each job runs once and jobs of the same slot never at the same time
+	{
+		const intptr_t jobsCount = 20000;
+		const int threadsCount = cTestWorkers + 1;
+
+		std::vector<std::atomic<int>> runs(jobsCount);
+		std::vector<std::atomic<int>> slotRuns(threadsCount);
+
+		std::atomic<bool> slotsOk {true};
+
+		for (auto& r: runs)
+			r = 0;
+
+		for (auto& r: slotRuns)
+			r = 0;
+
+		ThreadPool::parallelFor(jobsCount, threadsCount,
+			[&](intptr_t job, int slot)
+			{
+				if (slot < 0 || slot >= threadsCount || slotRuns[slot]++ != 0)
+				{
+					slotsOk = false;
+					return;
+				}
+
+				++runs[job];
+				--slotRuns[slot];
+			});
+
+		CHECK(slotsOk);
+		CHECK(std::all_of(runs.begin(), runs.end(), [](const std::atomic<int>& r) { return r == 1; }));
+	}
+
+	// Nested loops
+	{
+		std::atomic<intptr_t> jobsRun {0};
+
+		ThreadPool::parallelFor(16, cTestWorkers + 1,
+			[&](intptr_t, int)
+			{
+				ThreadPool::parallelFor(100, cTestWorkers + 1, [&](intptr_t, int) { ++jobsRun; });
+			});
+
+		CHECK(jobsRun == 1600);
+	}
+
+	// A job's exception is re-thrown to the caller
+	{
+		bool caught = false;
+
+		try
+		{
+			ThreadPool::parallelFor(1000, cTestWorkers + 1,
+				[](intptr_t job, int)
+				{
+					if (job == 500)
+						throw std::runtime_error("job failed");
+				});
+		}
+		catch (std::runtime_error&)
+		{
+			caught = true;
+		}
+
+		CHECK(caught);
+	}
+
+	// Changing the workers count while loops run
+	{
+		std::atomic<intptr_t> jobsRun {0};
+
+		auto loopsFn =
+			[&]()
+			{
+				for (int i = 0; i < 200; ++i)
+					ThreadPool::parallelFor(50, cTestWorkers + 1, [&](intptr_t, int) { ++jobsRun; });
+			};
+
+		std::thread loopsThread(loopsFn);
+
+		for (int i = 0; i < 200; ++i)
+		{
+			ThreadPool::setWorkersCount(i % 4);
+			std::this_thread::yield();
+		}
+
+		loopsFn();
+		loopsThread.join();
+
+		CHECK(jobsRun == 2 * 200 * 50);
+
+		ThreadPool::setWorkersCount(cTestWorkers);
+
+		std::atomic<intptr_t> slotsUsed {0};
+
+		ThreadPool::parallelFor(4, 8, [&](intptr_t, int slot) { slotsUsed |= (intptr_t(1) << slot); });
+
+		CHECK(ThreadPool::workersCount() == cTestWorkers);
+		CHECK(slotsUsed < (intptr_t(1) << (cTestWorkers + 1)));
+	}
+}
+
+
+/**
+ *  \class  MemoryDocument
+ *  \brief  Compare engine input held in memory
+ */
+class MemoryDocument : public DocumentSource
+{
+public:
+	MemoryDocument(const std::string& text) : _text(text) {}
+
+	virtual const char* text() const
+	{
+		return _text.data();
+	}
+
+	virtual intptr_t length() const
+	{
+		return static_cast<intptr_t>(_text.size());
+	}
+
+private:
+	const std::string _text;
+};
+
+
+/**
+ *  \class  RecordingSink
+ *  \brief  Keeps all compare engine marks as text
+ */
+class RecordingSink : public DiffSink
+{
+public:
+	virtual void clear(int)
+	{
+		marks.clear();
+	}
+
+	virtual void markLine(int view, intptr_t line, int markMask)
+	{
+		marks.push_back("L " + std::to_string(view) + " " + std::to_string(line) + " " + std::to_string(markMask));
+	}
+
+	virtual void markLineChanges(int view, intptr_t line, const std::vector<section_t>& changes, int blockDiffMask)
+	{
+		std::string mark = "C " + std::to_string(view) + " " + std::to_string(line) + " " +
+				std::to_string(blockDiffMask);
+
+		for (const auto& change: changes)
+			mark += " " + std::to_string(change.off) + "," + std::to_string(change.len);
+
+		marks.push_back(mark);
+	}
+
+	std::vector<std::string> marks;
+};
+
+
+struct CompareOutput
+{
+	CompareResult				result;
+	CompareSummary				summary;
+	std::vector<std::string>	marks;
+};
+
+
+CompareOutput compare(const std::string& text1, const std::string& text2, const CompareOptions& options,
+		int threadsCount)
+{
+	setWorkerThreads(threadsCount);
+
+	const MemoryDocument doc1(text1);
+	const MemoryDocument doc2(text2);
+
+	RecordingSink sink;
+	CompareOutput output;
+
+	output.result = runCompare(doc1, doc2, sink, options, output.summary);
+	output.marks = std::move(sink.marks);
+
+	return output;
+}
+
+
+bool isSameOutput(const CompareOutput& output1, const CompareOutput& output2)
+{
+	return (output1.result == output2.result && output1.marks == output2.marks &&
+			output1.summary.diffLines == output2.summary.diffLines &&
+			output1.summary.added == output2.summary.added &&
+			output1.summary.removed == output2.summary.removed &&
+			output1.summary.moved == output2.summary.moved &&
+			output1.summary.changed == output2.summary.changed &&
+			output1.summary.match == output2.summary.match &&
+			output1.summary.approximate == output2.summary.approximate);
+}
+
+
+void setDefaultOptions(CompareOptions& options)
+{
+	options.newFileViewId			= SUB_VIEW;
+	options.findUniqueMode			= false;
+	options.alignAllMatches			= false;
+	options.neverMarkIgnored		= false;
+	options.detectMoves				= true;
+	options.detectCharDiffs			= false;
+	options.fastCharDiffs			= false;
+	options.bestSeqChangedLines		= false;
+	options.histogramDiff			= false;
+	options.discardUnmatchedLines	= false;
+	options.minimalLinesDiff		= false;
+	options.ignoreSpaces			= false;
+	options.ignoreEmptyLines		= false;
+	options.ignoreCase				= false;
+	options.changedThresholdPercent	= 50;
+	options.selectionCompare		= false;
+}
+
+
+std::string randomLine(std::mt19937& rng, int minWords, int maxWords)
+{
+	static const char* const cWords[] = { "int", "value", "count", "result", "index", "buffer", "size", "return",
+			"if", "for", "while", "auto", "const", "line", "text", "pos", "len", "data", "item", "{", "}" };
+
+	std::string line;
+
+	for (int words = minWords + rng() % (maxWords - minWords + 1); words; --words)
+	{
+		if (!line.empty())
+			line += ' ';
+
+		line += cWords[rng() % (sizeof(cWords) / sizeof(cWords[0]))];
+		line += std::to_string(rng() % 100);
+	}
+
+	return line + ";";
+}
+
+
+// A random document and its edited copy - lines changed in a char or a word, added, removed and moved
+void randomDocuments(std::mt19937& rng, int linesCount, std::string& text1, std::string& text2)
+{
+	std::vector<std::string> lines1;
+	std::vector<std::string> lines2;
+
+	for (int i = 0; i < linesCount; ++i)
+		lines1.push_back((rng() % 10) ? randomLine(rng, 2, 10) : std::string());
+
+	for (const auto& line: lines1)
+	{
+		switch (rng() % 30)
+		{
+			case 0:		// removed
+			break;
+
+			case 1:		// added
+				lines2.push_back(randomLine(rng, 2, 10));
+				lines2.push_back(line);
+			break;
+
+			case 2:		// a char changed
+			{
+				std::string changed = line;
+
+				if (!changed.empty())
+					changed[rng() % changed.size()] = 'x';
+
+				lines2.push_back(changed);
+			}
+			break;
+
+			case 3:		// a word added
+				lines2.push_back("auto " + line);
+			break;
+
+			default:
+				lines2.push_back(line);
+		}
+	}
+
+	// A moved block
+	if (lines2.size() > 100)
+	{
+		const size_t from = rng() % (lines2.size() / 2);
+		const std::vector<std::string> block(lines2.begin() + from, lines2.begin() + from + 10);
+
+		lines2.erase(lines2.begin() + from, lines2.begin() + from + 10);
+		lines2.insert(lines2.end() - 20, block.begin(), block.end());
+	}
+
+	text1.clear();
+	text2.clear();
+
+	for (const auto& line: lines1)
+		text1 += line + "\n";
+
+	for (const auto& line: lines2)
+		text2 += line + ((rng() % 2) ? "\n" : "\r\n");
+}
+
+
+void testEngine()
+{
+	std::mt19937 rng(78901);
+
+	CompareOptions options;
+	setDefaultOptions(options);
+
+	std::string text1;
+	std::string text2;
+
+	randomDocuments(rng, 500, text1, text2);
+
+	CHECK(compare(text1, text1, options, 1).result == CompareResult::COMPARE_MATCH);
+
+	// A char changed in a short line - its char diffs are traced by DiffCalc or from the bit-parallel LCS
+	for (bool fastCharDiffs: { false, true })
+	{
+		const std::string changedText = "first line\nsecond line\nthird line\n";
+		const std::string originalText = "first line\nsecund line\nthird line\n";
+
+		options.detectCharDiffs = true;
+		options.fastCharDiffs = fastCharDiffs;
+
+		const CompareOutput output = compare(changedText, originalText, options, 1);
+
+		setDefaultOptions(options);
+
+		CHECK(output.result == CompareResult::COMPARE_MISMATCH);
+		CHECK(output.summary.changed == 1);
+		CHECK(std::count_if(output.marks.begin(), output.marks.end(),
+				[](const std::string& mark) { return mark.compare(0, 4, "C 0 ") == 0; }) == 1);
+		CHECK(std::find_if(output.marks.begin(), output.marks.end(),
+				[](const std::string& mark) { return mark.compare(0, 6, "C 0 1 ") == 0 &&
+						mark.find(" 3,1") != std::string::npos; }) != output.marks.end());
+	}
+
+	// Serial and parallel compares give the same results - the big documents' lines diff is split between threads
+	for (int linesCount: { 500, 6000 })
+	{
+		randomDocuments(rng, linesCount, text1, text2);
+
+		for (int optionsSet = 0; optionsSet < 9; ++optionsSet)
+		{
+			setDefaultOptions(options);
+
+			options.detectCharDiffs		= (optionsSet == 1 || optionsSet == 5 || optionsSet == 6);
+			options.fastCharDiffs		= (optionsSet == 6);
+			options.ignoreSpaces		= (optionsSet == 2);
+			options.ignoreCase			= (optionsSet == 2);
+			options.histogramDiff		= (optionsSet == 3);
+			options.bestSeqChangedLines	= (optionsSet == 4);
+			options.detectMoves			= (optionsSet != 5);
+			options.discardUnmatchedLines	= (optionsSet == 7);
+			options.minimalLinesDiff		= (optionsSet == 8);
+
+			const CompareOutput serialOutput = compare(text1, text2, options, 1);
+			const CompareOutput parallelOutput = compare(text1, text2, options, cTestWorkers + 1);
+
+			CHECK(serialOutput.result == CompareResult::COMPARE_MISMATCH);
+			CHECK(isSameOutput(serialOutput, parallelOutput));
+		}
+	}
+
+	// A huge changed block - its line pairs are pruned by the LSH sketch index and the compare is approximate
+	{
+		text1.clear();
+		text2.clear();
+
+		for (int i = 0; i < 2000; ++i)
+		{
+			const std::string line = randomLine(rng, 2, 4);
+
+			text1 += line + "\n";
+			text2 += "\t" + line.substr(0, line.size() - 1) + " ;\n";
+		}
+
+		setDefaultOptions(options);
+
+		for (bool detectCharDiffs: { false, true })
+		{
+			options.detectCharDiffs = detectCharDiffs;
+
+			const CompareOutput serialOutput = compare(text1, text2, options, 1);
+			const CompareOutput parallelOutput = compare(text1, text2, options, cTestWorkers + 1);
+
+			CHECK(serialOutput.summary.approximate);
+			CHECK(serialOutput.summary.changed > 0);
+			CHECK(isSameOutput(serialOutput, parallelOutput));
+		}
+	}
+
+	setWorkerThreads(0);
+}
+
+}
+
+
+int main()
+{
+	testLineHash();
+	testMyersScripts();
+	testSuffixTrim();
+	testHistogramScripts();
+	testBoundedCost();
+	testMaxDistance();
+	testVisit();
+	testParallelDiff();
+	testThreadPool();
+	testEngine();
+
+	if (failedChecks)
+	{
+		std::fprintf(stderr, "%d checks failed\n", failedChecks);
+		return 1;
+	}
+
+	std::printf("All checks passed\n");
+
+	return 0;
+}
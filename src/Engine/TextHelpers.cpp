@@ -0,0 +1,275 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cwctype>
+#endif
+
+#include "TextHelpers.h"
+
+
+#ifdef _WIN32
+
+std::vector<wchar_t> toWideChar(const char* text, intptr_t len)
+{
+	if (len <= 0)
+		return std::vector<wchar_t>();
+
+	const int wLen = ::MultiByteToWideChar(CP_UTF8, 0, text, static_cast<int>(len), NULL, 0);
+
+	std::vector<wchar_t> wText(wLen);
+
+	::MultiByteToWideChar(CP_UTF8, 0, text, static_cast<int>(len), wText.data(), wLen);
+
+	return wText;
+}
+
+
+intptr_t wideCharToUtf8Len(const wchar_t* text, intptr_t len)
+{
+	if (len <= 0)
+		return 0;
+
+	return ::WideCharToMultiByte(CP_UTF8, 0, text, static_cast<int>(len), NULL, 0, NULL, NULL);
+}
+
+
+void toLowerCase(wchar_t* text, intptr_t len)
+{
+	if (len > 0)
+		::CharLowerBuffW(text, static_cast<DWORD>(len));
+}
+
+
+void toLowerCase(std::vector<char>& text)
+{
+	const int len = static_cast<int>(text.size());
+
+	if (len == 0)
+		return;
+
+	const int wLen = ::MultiByteToWideChar(CP_UTF8, 0, text.data(), len, NULL, 0);
+
+	std::vector<wchar_t> wText(wLen);
+
+	::MultiByteToWideChar(CP_UTF8, 0, text.data(), len, wText.data(), wLen);
+
+	wText.push_back(L'\0');
+	::CharLowerW((LPWSTR)wText.data());
+	wText.pop_back();
+
+	::WideCharToMultiByte(CP_UTF8, 0, wText.data(), wLen, text.data(), len, NULL, NULL);
+}
+
+
+bool isCharAlphaNumeric(wchar_t letter)
+{
+	return (::IsCharAlphaNumericW(letter) != FALSE);
+}
+
+#else
+
+namespace {
+
+const uint32_t cReplacementChar = 0xFFFD;
+
+
+// Decodes single UTF-8 code point at text[pos] and advances pos. Invalid sequences decode to U+FFFD
+// consuming a single byte (same as MultiByteToWideChar() does)
+uint32_t decodeUtf8(const unsigned char* text, intptr_t len, intptr_t& pos)
+{
+	const uint32_t lead = text[pos++];
+
+	if (lead < 0x80)
+		return lead;
+
+	intptr_t	seqLen;
+	uint32_t	cp;
+	uint32_t	minCp;
+
+	if ((lead & 0xE0) == 0xC0)
+	{
+		seqLen	= 1;
+		cp		= lead & 0x1F;
+		minCp	= 0x80;
+	}
+	else if ((lead & 0xF0) == 0xE0)
+	{
+		seqLen	= 2;
+		cp		= lead & 0x0F;
+		minCp	= 0x800;
+	}
+	else if ((lead & 0xF8) == 0xF0)
+	{
+		seqLen	= 3;
+		cp		= lead & 0x07;
+		minCp	= 0x10000;
+	}
+	else
+	{
+		return cReplacementChar;
+	}
+
+	if (pos + seqLen > len)
+		return cReplacementChar;
+
+	for (intptr_t i = 0; i < seqLen; ++i)
+	{
+		if ((text[pos + i] & 0xC0) != 0x80)
+			return cReplacementChar;
+
+		cp = (cp << 6) | (text[pos + i] & 0x3F);
+	}
+
+	if (cp < minCp || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+		return cReplacementChar;
+
+	pos += seqLen;
+
+	return cp;
+}
+
+
+inline intptr_t utf8Len(uint32_t cp)
+{
+	return (cp < 0x80) ? 1 : (cp < 0x800) ? 2 : (cp < 0x10000) ? 3 : 4;
+}
+
+
+void encodeUtf8(uint32_t cp, std::vector<char>& text)
+{
+	if (cp < 0x80)
+	{
+		text.push_back(static_cast<char>(cp));
+	}
+	else if (cp < 0x800)
+	{
+		text.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+		text.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+	}
+	else if (cp < 0x10000)
+	{
+		text.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+		text.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+		text.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+	}
+	else
+	{
+		text.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+		text.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+		text.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+		text.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+	}
+}
+
+}
+
+
+std::vector<wchar_t> toWideChar(const char* text, intptr_t len)
+{
+	std::vector<wchar_t> wText;
+
+	if (len <= 0)
+		return wText;
+
+	wText.reserve(len);
+
+	const unsigned char* uText = reinterpret_cast<const unsigned char*>(text);
+
+	for (intptr_t pos = 0; pos < len;)
+	{
+		const uint32_t cp = decodeUtf8(uText, len, pos);
+
+		if (sizeof(wchar_t) == 2 && cp >= 0x10000)
+		{
+			wText.push_back(static_cast<wchar_t>(0xD800 + ((cp - 0x10000) >> 10)));
+			wText.push_back(static_cast<wchar_t>(0xDC00 + ((cp - 0x10000) & 0x3FF)));
+		}
+		else
+		{
+			wText.push_back(static_cast<wchar_t>(cp));
+		}
+	}
+
+	return wText;
+}
+
+
+intptr_t wideCharToUtf8Len(const wchar_t* text, intptr_t len)
+{
+	intptr_t utf8len = 0;
+
+	for (intptr_t i = 0; i < len; ++i)
+	{
+		const uint32_t cp = static_cast<uint32_t>(text[i]);
+
+		// Surrogate pair in UTF-16 encodes 4 bytes long UTF-8 sequence
+		if (sizeof(wchar_t) == 2 && cp >= 0xD800 && cp <= 0xDBFF && i + 1 < len)
+		{
+			utf8len += 4;
+			++i;
+		}
+		else
+		{
+			utf8len += utf8Len(cp);
+		}
+	}
+
+	return utf8len;
+}
+
+
+void toLowerCase(wchar_t* text, intptr_t len)
+{
+	for (intptr_t i = 0; i < len; ++i)
+		text[i] = static_cast<wchar_t>(std::towlower(static_cast<wint_t>(text[i])));
+}
+
+
+void toLowerCase(std::vector<char>& text)
+{
+	const intptr_t len = static_cast<intptr_t>(text.size());
+
+	if (len == 0)
+		return;
+
+	const unsigned char* uText = reinterpret_cast<const unsigned char*>(text.data());
+
+	std::vector<char> lowerText;
+	lowerText.reserve(len);
+
+	for (intptr_t pos = 0; pos < len;)
+		encodeUtf8(static_cast<uint32_t>(std::towlower(static_cast<wint_t>(decodeUtf8(uText, len, pos)))),
+				lowerText);
+
+	text = std::move(lowerText);
+}
+
+
+bool isCharAlphaNumeric(wchar_t letter)
+{
+	return (std::iswalnum(static_cast<wint_t>(letter)) != 0);
+}
+
+#endif // _WIN32
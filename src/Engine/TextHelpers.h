@@ -0,0 +1,34 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+
+// Text conversion helpers used by the compare engine. On Windows these are thin wrappers around the Win32 API,
+// elsewhere portable equivalents are used (wchar_t text is UTF-16 on Windows and UTF-32 otherwise).
+
+std::vector<wchar_t> toWideChar(const char* text, intptr_t len);
+intptr_t wideCharToUtf8Len(const wchar_t* text, intptr_t len);
+
+void toLowerCase(wchar_t* text, intptr_t len);
+void toLowerCase(std::vector<char>& text);
+
+bool isCharAlphaNumeric(wchar_t letter);
@@ -0,0 +1,362 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef MULTITHREAD
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+#include "ThreadPool.h"
+
+
+namespace {
+
+std::mutex poolMtx;
+
+// Replaced only while no loop runs and never destroyed otherwise - its idle workers are left to the process exit
+// (joining threads on DLL unload can deadlock)
+ThreadPool* pool = nullptr;
+
+// The set count (negative - the default one) and the count the pool is created with
+int poolWorkersCount = -1;
+int poolCreatedCount = -1;
+
+// The loops running on the pool
+int poolLoops = 0;
+
+
+inline int getDefaultWorkersCount()
+{
+	const int threadsCount = static_cast<int>(std::thread::hardware_concurrency());
+
+	return (threadsCount > 1) ? threadsCount - 1 : 0;
+}
+
+
+// Guarded by poolMtx
+inline int getSetWorkersCount()
+{
+	return (poolWorkersCount < 0) ? getDefaultWorkersCount() : poolWorkersCount;
+}
+
+}
+
+
+struct ThreadPool::Loop
+{
+	struct JobsRange
+	{
+		std::mutex	mtx;
+		intptr_t	begin {0};
+		intptr_t	end {0};
+	};
+
+	Loop(int slotsCount, const std::function<void(intptr_t, int)>& fn) : ranges(slotsCount), jobFn(fn) {}
+
+	std::vector<JobsRange>						ranges;
+	const std::function<void(intptr_t, int)>&	jobFn;
+
+	// The next slot for a joining worker - the caller's is 0. Guarded by the pool's mutex
+	int							nextSlot {1};
+
+	std::atomic<bool>			stop {false};
+
+	std::mutex					doneMtx;
+	std::condition_variable		doneCv;
+	int							activeWorkers {0};
+	std::exception_ptr			exception;
+};
+
+
+void ThreadPool::setWorkersCount(int workersCount)
+{
+	std::lock_guard<std::mutex> lock(poolMtx);
+
+	poolWorkersCount = workersCount;
+}
+
+
+int ThreadPool::workersCount()
+{
+	std::lock_guard<std::mutex> lock(poolMtx);
+
+	return getSetWorkersCount();
+}
+
+
+void ThreadPool::parallelFor(intptr_t jobsCount, int threadsCount, const std::function<void(intptr_t, int)>& jobFn)
+{
+	if (jobsCount <= 0)
+		return;
+
+	if (threadsCount <= 1 || jobsCount == 1)
+	{
+		for (intptr_t job = 0; job < jobsCount; ++job)
+			jobFn(job, 0);
+
+		return;
+	}
+
+	ThreadPool* loopPool;
+
+	{
+		std::lock_guard<std::mutex> lock(poolMtx);
+
+		const int workersCount = getSetWorkersCount();
+
+		// A pool in use cannot be replaced - it is left for a later loop
+		if (pool && poolLoops == 0 && poolCreatedCount != workersCount)
+		{
+			delete pool;
+			pool = nullptr;
+		}
+
+		if (!pool)
+		{
+			pool = new ThreadPool(workersCount);
+			poolCreatedCount = workersCount;
+		}
+
+		loopPool = pool;
+		++poolLoops;
+	}
+
+	try
+	{
+		loopPool->run(jobsCount, threadsCount, jobFn);
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(poolMtx);
+		--poolLoops;
+
+		throw;
+	}
+
+	std::lock_guard<std::mutex> lock(poolMtx);
+	--poolLoops;
+}
+
+
+ThreadPool::ThreadPool(int workersCount)
+{
+	for (int i = 0; i < workersCount; ++i)
+	{
+		try
+		{
+			_workers.emplace_back(&ThreadPool::workerFn, this);
+		}
+		catch (...)
+		{
+			break;
+		}
+	}
+}
+
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		_stop = true;
+	}
+
+	_cv.notify_all();
+
+	for (auto& worker : _workers)
+		worker.join();
+}
+
+
+void ThreadPool::run(intptr_t jobsCount, int threadsCount, const std::function<void(intptr_t, int)>& jobFn)
+{
+	threadsCount = std::min(threadsCount, static_cast<int>(_workers.size()) + 1);
+
+	if (threadsCount > jobsCount)
+		threadsCount = static_cast<int>(jobsCount);
+
+	if (threadsCount <= 1)
+	{
+		for (intptr_t job = 0; job < jobsCount; ++job)
+			jobFn(job, 0);
+
+		return;
+	}
+
+	Loop loop(threadsCount, jobFn);
+
+	for (int slot = 0; slot < threadsCount; ++slot)
+	{
+		loop.ranges[slot].begin	= jobsCount * slot / threadsCount;
+		loop.ranges[slot].end	= jobsCount * (slot + 1) / threadsCount;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		_loops.emplace_back(&loop);
+	}
+
+	_cv.notify_all();
+
+	runJobs(loop, 0);
+
+	// No jobs left to take - let no more workers join and wait for the joined ones to finish
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+
+		auto loopI = std::find(_loops.begin(), _loops.end(), &loop);
+
+		if (loopI != _loops.end())
+			_loops.erase(loopI);
+	}
+
+	std::unique_lock<std::mutex> lock(loop.doneMtx);
+
+	loop.doneCv.wait(lock, [&loop]() { return (loop.activeWorkers == 0); });
+
+	if (loop.exception)
+		std::rethrow_exception(loop.exception);
+}
+
+
+void ThreadPool::workerFn()
+{
+	for (;;)
+	{
+		Loop* loop;
+		int slot;
+
+		{
+			std::unique_lock<std::mutex> lock(_mtx);
+
+			_cv.wait(lock, [this]() { return (_stop || !_loops.empty()); });
+
+			if (_stop)
+				return;
+
+			loop = _loops.front();
+			slot = loop->nextSlot++;
+
+			if (loop->nextSlot == static_cast<int>(loop->ranges.size()))
+				_loops.pop_front();
+
+			std::lock_guard<std::mutex> doneLock(loop->doneMtx);
+			++loop->activeWorkers;
+		}
+
+		runJobs(*loop, slot);
+
+		// Notify under the lock - the loop is gone as soon as its caller sees no active workers
+		std::lock_guard<std::mutex> doneLock(loop->doneMtx);
+
+		if (--loop->activeWorkers == 0)
+			loop->doneCv.notify_all();
+	}
+}
+
+
+void ThreadPool::runJobs(Loop& loop, int slot)
+{
+	try
+	{
+		for (intptr_t job; takeJob(loop, slot, job);)
+			loop.jobFn(job, slot);
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(loop.doneMtx);
+
+		if (!loop.exception)
+			loop.exception = std::current_exception();
+
+		loop.stop = true;
+	}
+}
+
+
+bool ThreadPool::takeJob(Loop& loop, int slot, intptr_t& job)
+{
+	if (loop.stop)
+		return false;
+
+	Loop::JobsRange& own = loop.ranges[slot];
+
+	{
+		std::lock_guard<std::mutex> lock(own.mtx);
+
+		if (own.begin < own.end)
+		{
+			job = own.begin++;
+			return true;
+		}
+	}
+
+	const int slotsCount = static_cast<int>(loop.ranges.size());
+
+	for (;;)
+	{
+		int victim = -1;
+		intptr_t victimJobs = 0;
+
+		for (int i = 0; i < slotsCount; ++i)
+		{
+			if (i == slot)
+				continue;
+
+			std::lock_guard<std::mutex> lock(loop.ranges[i].mtx);
+
+			if (victimJobs < loop.ranges[i].end - loop.ranges[i].begin)
+			{
+				victimJobs	= loop.ranges[i].end - loop.ranges[i].begin;
+				victim		= i;
+			}
+		}
+
+		if (victim < 0)
+			return false;
+
+		intptr_t stolenBegin;
+		intptr_t stolenEnd;
+
+		{
+			Loop::JobsRange& range = loop.ranges[victim];
+
+			std::lock_guard<std::mutex> lock(range.mtx);
+
+			// Emptied meanwhile - look again
+			if (range.begin >= range.end)
+				continue;
+
+			stolenEnd	= range.end;
+			stolenBegin	= range.end - (range.end - range.begin + 1) / 2;
+			range.end	= stolenBegin;
+		}
+
+		job = stolenBegin;
+
+		std::lock_guard<std::mutex> lock(own.mtx);
+
+		own.begin	= stolenBegin + 1;
+		own.end		= stolenEnd;
+
+		return true;
+	}
+}
+
+#endif // MULTITHREAD
@@ -0,0 +1,86 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef MULTITHREAD
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#if defined(__MINGW32__) && !defined(_GLIBCXX_HAS_GTHREADS)
+#include "../mingw-std-threads/mingw.thread.h"
+#include "../mingw-std-threads/mingw.mutex.h"
+#include "../mingw-std-threads/mingw.condition_variable.h"
+#else
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif // __MINGW32__ ...
+
+
+/**
+ *  \class  ThreadPool
+ *  \brief  Engine-wide worker threads created on first use and reused by all compares. A parallel loop's jobs are
+ *          split in index ranges, one per thread (the caller's included). Each thread takes its own range's jobs in
+ *          order and when done steals the back half of the biggest range left
+ */
+class ThreadPool
+{
+public:
+	// Sets the pool's workers count (negative - one less than the hardware threads as the calling thread works
+	// too). A pool of a different count is replaced when the next loop starts while no other one runs
+	static void setWorkersCount(int workersCount);
+
+	// The set workers count - loops running on a pool not replaced yet might get fewer or more threads
+	static int workersCount();
+
+	// Runs jobFn(job, slot) for all jobs in [0, jobsCount) on up to threadsCount threads of the pool (the calling
+	// thread included) - the pool is created on first use. slot is the running thread's index in [0, threadsCount)
+	// - jobs of the same slot never run at the same time. Only idle workers join so nested loops never wait for
+	// each other. The first exception thrown by a job stops the loop and is re-thrown in the caller's context after
+	// all its threads finish
+	static void parallelFor(intptr_t jobsCount, int threadsCount, const std::function<void(intptr_t, int)>& jobFn);
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+private:
+	struct Loop;
+
+	ThreadPool(int workersCount);
+	~ThreadPool();
+
+	void run(intptr_t jobsCount, int threadsCount, const std::function<void(intptr_t, int)>& jobFn);
+
+	void workerFn();
+
+	static void runJobs(Loop& loop, int slot);
+	static bool takeJob(Loop& loop, int slot, intptr_t& job);
+
+	std::vector<std::thread>	_workers;
+
+	std::mutex					_mtx;
+	std::condition_variable		_cv;
+	std::deque<Loop*>			_loops;
+	bool						_stop {false};
+};
+
+#endif // MULTITHREAD
@@ -40,12 +40,36 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cassert>
 #include <cstdint>
 #include <cstdlib>
 #include <climits>
+#include <exception>
+#include <functional>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+#ifdef MULTITHREAD
+
+#if defined(__MINGW32__) && !defined(_GLIBCXX_HAS_GTHREADS)
+#include "../mingw-std-threads/mingw.thread.h"
+#else
+#include <thread>
+#endif // __MINGW32__ ...
+
+#endif // MULTITHREAD
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define DIFF_SSE2		1
+#include <emmintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
-#include "varray.h"
 
 
 enum class diff_type
@@ -56,6 +80,27 @@ enum class diff_type
 };
 
 
+enum class diff_algorithm
+{
+	MYERS,
+	HISTOGRAM
+};
+
+
+// How DiffCalc compares sequences of equal size - both ways (keeping the result with more replacements) or as given
+enum class diff_orientation
+{
+	CHECK_BOTH,
+	CHECK_BOTH_CONCURRENTLY,	// both ways at the same time, on separate threads (if MULTITHREAD)
+	SINGLE
+};
+
+
+// Runs task(0) to task(tasks_count - 1), possibly at the same time, and returns when all of them are done - lets
+// DiffCalc's parallel parts run on the caller's threads (see DiffCalc::set_tasks_runner())
+using diff_tasks_runner = std::function<void(int tasks_count, const std::function<void(int)>& task)>;
+
+
 template <typename UserDataT>
 struct diff_info
 {
@@ -76,22 +121,302 @@ struct diff_info<void>
 };
 
 
+/**
+ *  \class  diff_match_run
+ *  \brief  Length of the run of equal elements of two sequences (up to max_len) - forward from a and b or backward
+ *          from a_end and b_end (none if max_len <= 0). Integral elements (the interned line IDs) are compared 16 bytes at a time
+ */
+template <typename Elem, bool Vectorized = std::is_integral<Elem>::value>
+struct diff_match_run
+{
+	static inline intptr_t forward(const Elem* a, const Elem* b, intptr_t max_len)
+	{
+		intptr_t len = 0;
+
+		while (len < max_len && a[len] == b[len])
+			++len;
+
+		return len;
+	}
+
+	static inline intptr_t backward(const Elem* a_end, const Elem* b_end, intptr_t max_len)
+	{
+		intptr_t len = 0;
+
+		while (len < max_len && a_end[-len - 1] == b_end[-len - 1])
+			++len;
+
+		return len;
+	}
+};
+
+
+#ifdef DIFF_SSE2
+
+template <typename Elem>
+struct diff_match_run<Elem, true>
+{
+	static const intptr_t cStep = 16 / sizeof(Elem);
+
+	// Mask of the equal bytes of the 16 bytes at a and b
+	static inline uint32_t equal_mask(const Elem* a, const Elem* b)
+	{
+		const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+		const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)));
+	}
+
+	static inline uint32_t lowest_bit(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long idx;
+		_BitScanForward(&idx, mask);
+
+		return idx;
+#else
+		return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+	}
+
+	static inline uint32_t highest_bit(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long idx;
+		_BitScanReverse(&idx, mask);
+
+		return idx;
+#else
+		return static_cast<uint32_t>(31 - __builtin_clz(mask));
+#endif
+	}
+
+	static inline intptr_t forward(const Elem* a, const Elem* b, intptr_t max_len)
+	{
+		// Most snakes are short - check the first elements one by one
+		intptr_t len = 0;
+
+		for (; len < cStep; ++len)
+		{
+			if (len >= max_len || a[len] != b[len])
+				return len;
+		}
+
+		for (; len + cStep <= max_len; len += cStep)
+		{
+			const uint32_t diff_mask = equal_mask(a + len, b + len) ^ 0xFFFF;
+
+			if (diff_mask)
+				return len + lowest_bit(diff_mask) / sizeof(Elem);
+		}
+
+		while (len < max_len && a[len] == b[len])
+			++len;
+
+		return len;
+	}
+
+	static inline intptr_t backward(const Elem* a_end, const Elem* b_end, intptr_t max_len)
+	{
+		intptr_t len = 0;
+
+		for (; len < cStep; ++len)
+		{
+			if (len >= max_len || a_end[-len - 1] != b_end[-len - 1])
+				return len;
+		}
+
+		for (; len + cStep <= max_len; len += cStep)
+		{
+			const uint32_t diff_mask = equal_mask(a_end - len - cStep, b_end - len - cStep) ^ 0xFFFF;
+
+			if (diff_mask)
+				return len + (cStep - 1 - highest_bit(diff_mask) / sizeof(Elem));
+		}
+
+		while (len < max_len && a_end[-len - 1] == b_end[-len - 1])
+			++len;
+
+		return len;
+	}
+};
+
+#endif // DIFF_SSE2
+
+
+/**
+ *  \class  DiffWorkspace
+ *  \brief  Reusable V-vectors buffer of DiffCalc - grown between the search steps only so the snake loops never
+ *          allocate. Each thread has its own one (see local()) kept between the compares
+ */
+class DiffWorkspace
+{
+public:
+	DiffWorkspace() {}
+
+	DiffWorkspace(const DiffWorkspace&) = delete;
+	const DiffWorkspace& operator=(const DiffWorkspace&) = delete;
+
+	inline intptr_t* data()
+	{
+		return _buf.data();
+	}
+
+	inline size_t size() const
+	{
+		return _buf.size();
+	}
+
+	// Grows the buffer (geometrically, up to maxSize) to at least size elements keeping its contents
+	inline intptr_t* grow(size_t size, size_t maxSize)
+	{
+		if (_buf.size() < size)
+		{
+			size_t newSize = 2 * _buf.size();
+
+			if (newSize > maxSize)
+				newSize = maxSize;
+
+			_buf.resize((newSize > size) ? newSize : size);
+		}
+
+		return _buf.data();
+	}
+
+	// Frees the buffer if it has grown too big to be kept
+	inline void trim()
+	{
+		if (_buf.size() > cMaxKeptSize)
+		{
+			_buf.clear();
+			_buf.shrink_to_fit();
+		}
+	}
+
+	// The calling thread's workspace
+	static DiffWorkspace& local()
+	{
+		static thread_local DiffWorkspace workspace;
+
+		return workspace;
+	}
+
+	// The calling thread's workspace or spare if a compare uses it already (a parallel part of that compare can run
+	// on the same thread)
+	static DiffWorkspace& free_local(DiffWorkspace& spare)
+	{
+		DiffWorkspace& workspace = local();
+
+		return workspace._in_use ? spare : workspace;
+	}
+
+	/**
+	 *  \class  scoped_use
+	 *  \brief  Marks the workspace as used by a compare for the object's lifetime (unless it already is)
+	 */
+	class scoped_use
+	{
+	public:
+		scoped_use(DiffWorkspace& workspace) : _ws(workspace._in_use ? nullptr : &workspace)
+		{
+			if (_ws)
+				_ws->_in_use = true;
+		}
+
+		~scoped_use()
+		{
+			if (_ws)
+				_ws->_in_use = false;
+		}
+
+		scoped_use(const scoped_use&) = delete;
+		const scoped_use& operator=(const scoped_use&) = delete;
+
+	private:
+		DiffWorkspace* _ws;
+	};
+
+private:
+	static const size_t cMaxKeptSize = 1 << 20;
+
+	std::vector<intptr_t> _buf;
+	bool _in_use {false};
+};
+
+
 /**
  *  \class  DiffCalc
  *  \brief  Compares and makes a differences list between two vectors (elements are template, must have operator==)
+ *
+ *  If the elements are unsigned integral equivalence class IDs (dense, see internLines() in Engine.cpp) the
+ *  elements without a counterpart in the other sequence can be discarded before the search (as GNU diff's
+ *  discard_confusing_lines() does) - they can never be part of a snake. Such sequences can also be compared with
+ *  the histogram diff (see _histogram_ses()) instead of Myers' algorithm. Both index tables by the elements - their
+ *  size is the classes count if it is given (see set_classes_count()).
  */
 template <typename Elem, typename UserDataT = void>
 class DiffCalc
 {
 public:
-	DiffCalc(const std::vector<Elem>& v1, const std::vector<Elem>& v2, intptr_t max = INTPTR_MAX);
-	DiffCalc(const Elem v1[], intptr_t v1_size, const Elem v2[], intptr_t v2_size, intptr_t max = INTPTR_MAX);
+	// The compare gives up (and returns no differences) as soon as the edit distance is known to reach max.
+	// If workspace is nullptr the calling thread's one is used
+	DiffCalc(const std::vector<Elem>& v1, const std::vector<Elem>& v2, intptr_t max = INTPTR_MAX,
+			DiffWorkspace* workspace = nullptr);
+	DiffCalc(const Elem v1[], intptr_t v1_size, const Elem v2[], intptr_t v2_size, intptr_t max = INTPTR_MAX,
+			DiffWorkspace* workspace = nullptr);
 
 	// Runs the actual compare and returns the differences + swap flag indicating if the
 	// compared sequences have been swapped for better results (if true, _a and _b have been swapped,
 	// meaning that DIFF_IN_1 in the differences is regarding _b instead of _a)
 	std::pair<std::vector<diff_info<UserDataT>>, bool> operator()(bool doDiffsCombine = false,
-			bool doBoundaryShift = false);
+			bool doBoundaryShift = false, bool doDiscardUnmatched = false,
+			diff_algorithm algorithm = diff_algorithm::MYERS);
+
+	// Runs the compare as operator() but instead of returning the differences passes them one by one to
+	// visitor(const diff_info<UserDataT>& diff, bool swapped). The whole script is still built first but in a
+	// storage of the calling thread reused by its next calls (unless it has grown too big) - only the script of the
+	// swapped orientation check (see set_orientation()) is allocated anew. Returns the swap flag
+	template <typename Visitor>
+	bool visit(Visitor&& visitor, bool doDiffsCombine = false, bool doBoundaryShift = false,
+			bool doDiscardUnmatched = false, diff_algorithm algorithm = diff_algorithm::MYERS);
+
+	// Lets the compare split its biggest sub-problems between up to threads_count threads (the caller's included).
+	// The result is the same as the single threaded one
+	inline void set_parallel(int threads_count);
+
+	// The parallel parts of the compare run through runner instead of on threads of their own
+	inline void set_tasks_runner(diff_tasks_runner runner)
+	{
+		_tasks_runner = std::move(runner);
+	}
+
+	// Bounds the cost of the search as GNU diff does - if a middle snake is not found in about sqrt(N) steps
+	// the furthest reaching diagonal is used as split point instead. The script is valid but might not be minimal
+	inline void set_bounded_cost(bool bounded)
+	{
+		_bounded_cost = bounded;
+	}
+
+	inline void set_orientation(diff_orientation orientation)
+	{
+		_orientation = orientation;
+	}
+
+	// The elements are class IDs below count. Otherwise they are taken as dense only if they are not much bigger than
+	// the compared windows
+	inline void set_classes_count(size_t count)
+	{
+		_classes_count = count;
+	}
+
+	// True if the last compare's script is not minimal (the cost bound has been hit while searching it)
+	inline bool approximate() const
+	{
+		return _approximate;
+	}
+
+	// Number of replacements (removal directly followed by addition) in the diff script
+	static inline intptr_t count_replaces(const std::vector<diff_info<UserDataT>>& diff);
 
 	DiffCalc(const DiffCalc&) = delete;
 	const DiffCalc& operator=(const DiffCalc&) = delete;
@@ -101,13 +426,39 @@ private:
 		intptr_t x, y, u, v;
 	};
 
+	// _ses() sub-problem (offsets and sizes) or match (offset into a and size) left for later
+	struct ses_step {
+		intptr_t aoff, aend, boff, bend;
+		bool is_match;
+	};
+
 	inline intptr_t& _v(intptr_t k, intptr_t r);
+	static inline size_t _v_size(intptr_t asize, intptr_t bsize);
+	inline void _reserve_v(intptr_t maxK);
+	size_t _ids_count(intptr_t off, intptr_t asize, intptr_t bsize) const;
+	inline intptr_t _forward_run(intptr_t ax, intptr_t by, intptr_t max_len) const;
+	inline intptr_t _backward_run(intptr_t ax, intptr_t by, intptr_t max_len) const;
 	void _edit(diff_type type, intptr_t off, intptr_t len);
 	intptr_t _find_middle_snake(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend, middle_snake& ms);
+	bool _find_best_split(intptr_t aend, intptr_t bend, intptr_t d, middle_snake& ms);
 	intptr_t _ses(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend);
+	inline intptr_t _split_ses(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend);
+#ifdef MULTITHREAD
+	void _run_tasks(int tasks_count, const std::function<void(int)>& task);
+	intptr_t _parallel_ses(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend, int splits);
+#endif
+	intptr_t _discarding_ses(intptr_t off, intptr_t asize, intptr_t bsize, intptr_t suffix, std::true_type);
+	intptr_t _discarding_ses(intptr_t off, intptr_t asize, intptr_t bsize, intptr_t suffix, std::false_type);
+	static void _slide_changes(char* changed, const char* other_changed, const Elem* el, intptr_t size);
+	intptr_t _histogram_ses(intptr_t off, intptr_t asize, intptr_t bsize, intptr_t suffix, std::true_type);
+	intptr_t _histogram_ses(intptr_t off, intptr_t asize, intptr_t bsize, intptr_t suffix, std::false_type);
+	intptr_t _window_ses(intptr_t off, intptr_t asize, intptr_t bsize, intptr_t suffix, bool doDiscardUnmatched,
+			diff_algorithm algorithm);
+	bool _compare(bool doDiffsCombine, bool doBoundaryShift, bool doDiscardUnmatched, diff_algorithm algorithm);
 	void _combine_diffs();
 	void _shift_boundaries();
-	inline intptr_t _count_replaces();
+	intptr_t _window_diff(intptr_t off, intptr_t asize, intptr_t bsize, intptr_t suffix, bool doDiscardUnmatched,
+			diff_algorithm algorithm);
 
 	const Elem*	_a;
 	intptr_t _a_size;
@@ -116,23 +467,56 @@ private:
 
 	std::vector<diff_info<UserDataT>>	_diff;
 
-	const intptr_t		_dmax;
-	varray<intptr_t>	_buf;
+	const intptr_t	_dmax;
+	DiffWorkspace&	_ws;
+	intptr_t*		_vbuf;
+	size_t			_vsize;
+	size_t			_vmax;
+	int				_splits;
+	bool			_bounded_cost;
+	intptr_t		_cost_limit;
+	bool			_approximate;
+	diff_orientation	_orientation;
+	size_t			_classes_count;
+
+	// Where the common suffix begins (-1 if there is none) - the snakes along it are not compared, see _forward_run()
+	intptr_t		_suffix_aoff;
+	intptr_t		_suffix_boff;
+
+	diff_tasks_runner	_tasks_runner;
+
+	std::vector<ses_step>	_steps;
 };
 
 
 template <typename Elem, typename UserDataT>
-DiffCalc<Elem, UserDataT>::DiffCalc(const std::vector<Elem>& v1, const std::vector<Elem>& v2, intptr_t max) :
-	_a(v1.data()), _a_size(v1.size()), _b(v2.data()), _b_size(v2.size()), _dmax(max)
+DiffCalc<Elem, UserDataT>::DiffCalc(const std::vector<Elem>& v1, const std::vector<Elem>& v2, intptr_t max,
+		DiffWorkspace* workspace) :
+	_a(v1.data()), _a_size(v1.size()), _b(v2.data()), _b_size(v2.size()), _dmax(max),
+	_ws(workspace ? *workspace : DiffWorkspace::local()), _vbuf(nullptr), _vsize(0), _vmax(0), _splits(0),
+	_bounded_cost(false), _cost_limit(INTPTR_MAX), _approximate(false), _orientation(diff_orientation::CHECK_BOTH),
+	_classes_count(0), _suffix_aoff(-1), _suffix_boff(-1)
 {
 }
 
 
 template <typename Elem, typename UserDataT>
 DiffCalc<Elem, UserDataT>::DiffCalc(const Elem v1[], intptr_t v1_size, const Elem v2[], intptr_t v2_size,
-		intptr_t max) :
-	_a(v1), _a_size(v1_size), _b(v2), _b_size(v2_size), _dmax(max)
+		intptr_t max, DiffWorkspace* workspace) :
+	_a(v1), _a_size(v1_size), _b(v2), _b_size(v2_size), _dmax(max),
+	_ws(workspace ? *workspace : DiffWorkspace::local()), _vbuf(nullptr), _vsize(0), _vmax(0), _splits(0),
+	_bounded_cost(false), _cost_limit(INTPTR_MAX), _approximate(false), _orientation(diff_orientation::CHECK_BOTH),
+	_classes_count(0), _suffix_aoff(-1), _suffix_boff(-1)
+{
+}
+
+
+template <typename Elem, typename UserDataT>
+inline void DiffCalc<Elem, UserDataT>::set_parallel(int threads_count)
 {
+	// Each split level doubles the threads
+	for (_splits = 0; threads_count > 1; threads_count /= 2)
+		++_splits;
 }
 
 
@@ -142,7 +526,97 @@ inline intptr_t& DiffCalc<Elem, UserDataT>::_v(intptr_t k, intptr_t r)
 	/* Pack -N to N into 0 to N * 2 */
 	const intptr_t j = (k <= 0) ? (-k * 4 + r) : (k * 4 + (r - 2));
 
-	return _buf.get(j);
+	return _vbuf[j];
+}
+
+
+// The biggest V-vectors size needed to compare the windows - reverse search diagonals reach |a - b| + (a + b) / 2 + 1
+template <typename Elem, typename UserDataT>
+inline size_t DiffCalc<Elem, UserDataT>::_v_size(intptr_t asize, intptr_t bsize)
+{
+	const intptr_t maxK = ((asize > bsize) ? asize : bsize) + (asize + bsize) / 2 + 2;
+
+	return static_cast<size_t>(4 * maxK + 4);
+}
+
+
+// Makes room for the diagonals [-maxK, maxK]
+template <typename Elem, typename UserDataT>
+inline void DiffCalc<Elem, UserDataT>::_reserve_v(intptr_t maxK)
+{
+	const size_t size = static_cast<size_t>(4 * maxK + 4);
+
+	if (size > _vsize)
+	{
+		_vbuf	= _ws.grow(size, _vmax);
+		_vsize	= _ws.size();
+	}
+}
+
+
+// Size of a table indexed by the elements of the windows [off, off + asize) and [off, off + bsize) and the trimmed
+// common suffix - the classes count if it is given. 0 if the elements are not dense class IDs and the table would be
+// too big
+template <typename Elem, typename UserDataT>
+size_t DiffCalc<Elem, UserDataT>::_ids_count(intptr_t off, intptr_t asize, intptr_t bsize) const
+{
+	if (_classes_count)
+		return _classes_count;
+
+	const intptr_t suffix = (_suffix_aoff < 0) ? 0 : _a_size - _suffix_aoff;
+
+	Elem maxElem = 0;
+
+	for (intptr_t i = 0; i < asize + suffix; ++i)
+		if (maxElem < _a[off + i])
+			maxElem = _a[off + i];
+
+	for (intptr_t i = 0; i < bsize; ++i)
+		if (maxElem < _b[off + i])
+			maxElem = _b[off + i];
+
+	if (static_cast<uint64_t>(maxElem) > static_cast<uint64_t>(2 * (asize + bsize + 2 * suffix) + 1024))
+		return 0;
+
+	return static_cast<size_t>(maxElem) + 1;
+}
+
+
+// Length of the matching run starting at _a[ax] and _b[by] (up to max_len). The common suffix matches along its
+// diagonal - the part of the run in it is not compared
+template <typename Elem, typename UserDataT>
+inline intptr_t DiffCalc<Elem, UserDataT>::_forward_run(intptr_t ax, intptr_t by, intptr_t max_len) const
+{
+	if (_suffix_aoff >= 0 && ax - by == _suffix_aoff - _suffix_boff && ax + max_len > _suffix_aoff)
+	{
+		if (ax >= _suffix_aoff)
+			return max_len;
+
+		const intptr_t len = _suffix_aoff - ax;
+		const intptr_t run = diff_match_run<Elem>::forward(_a + ax, _b + by, len);
+
+		return (run < len) ? run : max_len;
+	}
+
+	return diff_match_run<Elem>::forward(_a + ax, _b + by, max_len);
+}
+
+
+// Length of the matching run ending before _a[ax] and _b[by] (up to max_len) - as _forward_run()
+template <typename Elem, typename UserDataT>
+inline intptr_t DiffCalc<Elem, UserDataT>::_backward_run(intptr_t ax, intptr_t by, intptr_t max_len) const
+{
+	if (_suffix_aoff >= 0 && ax - by == _suffix_aoff - _suffix_boff && ax > _suffix_aoff)
+	{
+		const intptr_t known = ax - _suffix_aoff;
+
+		if (known >= max_len)
+			return max_len;
+
+		return known + diff_match_run<Elem>::backward(_a + _suffix_aoff, _b + _suffix_boff, max_len - known);
+	}
+
+	return diff_match_run<Elem>::backward(_a + ax, _b + by, max_len);
 }
 
 
@@ -181,6 +655,9 @@ intptr_t DiffCalc<Elem, UserDataT>::_find_middle_snake(intptr_t aoff, intptr_t a
 	const intptr_t delta = aend - bend;
 	const intptr_t odd = delta & 1;
 	const intptr_t mid = (aend + bend) / 2 + odd;
+	const intptr_t absDelta = (delta < 0) ? -delta : delta;
+
+	_reserve_v(absDelta + 1);
 
 	_v(1, 0) = 0;
 	_v(delta - 1, 1) = aend;
@@ -192,6 +669,12 @@ intptr_t DiffCalc<Elem, UserDataT>::_find_middle_snake(intptr_t aoff, intptr_t a
 		if ((2 * d - 1) >= _dmax)
 			return _dmax;
 
+		// Too expensive - split at the furthest point reached so far
+		if (d >= _cost_limit && _find_best_split(aend, bend, d, ms))
+			return 2 * d;
+
+		_reserve_v(absDelta + d + 1);
+
 		for (k = d; k >= -d; k -= 2)
 		{
 			if (k == -d || (k != d && _v(k - 1, 0) < _v(k + 1, 0)))
@@ -204,10 +687,12 @@ intptr_t DiffCalc<Elem, UserDataT>::_find_middle_snake(intptr_t aoff, intptr_t a
 			ms.x = x;
 			ms.y = y;
 
-			while (x < aend && y < bend &&  _a[aoff + x] == _b[boff + y])
 			{
-				++x;
-				++y;
+				const intptr_t run = _forward_run(aoff + x, boff + y,
+						((aend - x) < (bend - y)) ? (aend - x) : (bend - y));
+
+				x += run;
+				y += run;
 			}
 
 			_v(k, 0) = x;
@@ -241,10 +726,11 @@ intptr_t DiffCalc<Elem, UserDataT>::_find_middle_snake(intptr_t aoff, intptr_t a
 			ms.u = x;
 			ms.v = y;
 
-			while (x > 0 && y > 0 &&  _a[aoff + x - 1] == _b[boff + y - 1])
 			{
-				--x;
-				--y;
+				const intptr_t run = _backward_run(aoff + x, boff + y, (x < y) ? x : y);
+
+				x -= run;
+				y -= run;
 			}
 
 			_v(kr, 1) = x;
@@ -266,314 +752,1153 @@ intptr_t DiffCalc<Elem, UserDataT>::_find_middle_snake(intptr_t aoff, intptr_t a
 }
 
 
+// GNU diff's "too expensive" heuristic: takes the point reached by the previous d forward or backward search that
+// is furthest from its start as split point (a zero length middle snake). False if no such point makes the problem
+// smaller
 template <typename Elem, typename UserDataT>
-intptr_t DiffCalc<Elem, UserDataT>::_ses(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend)
+bool DiffCalc<Elem, UserDataT>::_find_best_split(intptr_t aend, intptr_t bend, intptr_t d, middle_snake& ms)
 {
-	middle_snake ms = { 0 };
-	intptr_t d;
+	const intptr_t delta = aend - bend;
 
-	if (aend == 0)
-	{
-		_edit(diff_type::DIFF_IN_2, boff, bend);
-		d = bend;
-	}
-	else if (bend == 0)
-	{
-		_edit(diff_type::DIFF_IN_1, aoff, aend);
-		d = aend;
-	}
-	else
-	{
-		/* Find the middle "snake" around which we
-		 * recursively solve the sub-problems.
-		 */
-		d = _find_middle_snake(aoff, aend, boff, bend, ms);
-		if (d == -1)
-			return -1;
+	intptr_t fxbest = 0;
+	intptr_t fxybest = -1;
 
-		if (d >= _dmax)
-			return _dmax;
+	for (intptr_t k = d - 1; k >= -(d - 1); k -= 2)
+	{
+		if (k > aend || k < -bend)
+			continue;
 
-		if (d > 1)
-		{
-			if (_ses(aoff, ms.x, boff, ms.y) == -1)
-				return -1;
+		intptr_t x = _v(k, 0);
 
-			_edit(diff_type::DIFF_MATCH, aoff + ms.x, ms.u - ms.x);
+		if (x > aend)
+			x = aend;
 
-			aoff += ms.u;
-			boff += ms.v;
-			aend -= ms.u;
-			bend -= ms.v;
+		intptr_t y = x - k;
 
-			if (_ses(aoff, aend, boff, bend) == -1)
-				return -1;
-		}
-		else
+		if (y > bend)
 		{
-			intptr_t x = ms.x;
-			intptr_t u = ms.u;
-
-			/* There are only 4 base cases when the
-			 * edit distance is 1.
-			 *
-			 * aend > bend   bend > aend
-			 *
-			 *   -       |
-			 *    \       \    x != u
-			 *     \       \
-			 *
-			 *   \       \
-			 *    \       \    x == u
-			 *     -       |
-			 */
+			x = bend + k;
+			y = bend;
+		}
 
-			if (bend > aend)
-			{
-				if (x == u)
-				{
-					_edit(diff_type::DIFF_MATCH, aoff, aend);
-					_edit(diff_type::DIFF_IN_2, boff + (bend - 1), 1);
-				}
-				else
-				{
-					_edit(diff_type::DIFF_IN_2, boff, 1);
-					_edit(diff_type::DIFF_MATCH, aoff, aend);
-				}
-			}
-			else
-			{
-				if (x == u)
-				{
-					_edit(diff_type::DIFF_MATCH, aoff, bend);
-					_edit(diff_type::DIFF_IN_1, aoff + (aend - 1), 1);
-				}
-				else
-				{
-					_edit(diff_type::DIFF_IN_1, aoff, 1);
-					_edit(diff_type::DIFF_MATCH, aoff + 1, bend);
-				}
-			}
+		if (x >= 0 && y >= 0 && fxybest < x + y)
+		{
+			fxybest = x + y;
+			fxbest = x;
 		}
 	}
 
-	return d;
-}
-
+	intptr_t bxbest = 0;
+	intptr_t bxybest = INTPTR_MAX;
 
-// If a whole matching block is contained at the end of the next diff block shift match down:
-// If [] surrounds the marked differences, basically [abc]d[efgd]hi is the same as [abcdefg]dhi
-// We combine diffs to make results more compact and clean
-template <typename Elem, typename UserDataT>
-void DiffCalc<Elem, UserDataT>::_combine_diffs()
-{
-	for (intptr_t i = 1; i < static_cast<intptr_t>(_diff.size()); ++i)
+	for (intptr_t k = d - 1; k >= -(d - 1); k -= 2)
 	{
-		if (_diff[i].type != diff_type::DIFF_MATCH)
-			continue;
-
-		if (i + 1 < static_cast<intptr_t>(_diff.size()))
-		{
-			const Elem*	el	= _b;
+		const intptr_t kr = delta + k;
 
-			if (_diff[i + 1].type == diff_type::DIFF_IN_1)
-			{
-				// If there is DIFF_IN_2 after DIFF_IN_1 both sequences are changed - diff endings don't match for sure
-				if ((i + 2 < static_cast<intptr_t>(_diff.size())) && (_diff[i + 2].type == diff_type::DIFF_IN_2))
-				{
-					i += 2;
-					continue;
-				}
+		if (kr > aend || kr < -bend)
+			continue;
 
-				el	= _a;
-			}
+		intptr_t x = _v(kr, 1);
 
-			diff_info<UserDataT>& match = _diff[i];
-			diff_info<UserDataT>* next_diff = &_diff[i + 1];
+		if (x < 0)
+			x = 0;
 
-			if (match.len > next_diff->len)
-			{
-				++i;
-				continue;
-			}
+		intptr_t y = x - kr;
 
-			intptr_t match_len = match.len;
+		if (y < 0)
+		{
+			x = kr;
+			y = 0;
+		}
 
-			intptr_t match_off = next_diff->off - 1;
-			intptr_t check_off = next_diff->off + next_diff->len - 1;
+		if (x <= aend && y <= bend && x + y < bxybest)
+		{
+			bxybest = x + y;
+			bxbest = x;
+		}
+	}
 
-			while ((match_len > 0) && (el[match_off] == el[check_off]))
-			{
-				--match_off;
-				--check_off;
-				--match_len;
-			}
+	intptr_t x, y;
 
-			if (match_len > 0)
-			{
-				++i;
-				continue;
+	if (fxybest >= 0 && (bxybest == INTPTR_MAX || (aend + bend) - bxybest < fxybest))
+	{
+		x = fxbest;
+		y = fxybest - fxbest;
+	}
+	else if (bxybest != INTPTR_MAX)
+	{
+		x = bxbest;
+		y = bxybest - bxbest;
+	}
+	else
+	{
+		return false;
+	}
+
+	if ((x == 0 && y == 0) || (x == aend && y == bend))
+		return false;
+
+	ms.x = ms.u = x;
+	ms.y = ms.v = y;
+
+	_approximate = true;
+
+	return true;
+}
+
+// Hirschberg's recursion unrolled on an explicit stack (_steps) so very dissimilar sequences cannot exhaust the
+// thread's stack. Returns the edit distance of the whole problem
+template <typename Elem, typename UserDataT>
+intptr_t DiffCalc<Elem, UserDataT>::_ses(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend)
+{
+	// The top step is the next one in the edit script
+	const size_t base = _steps.size();
+
+	_steps.push_back({ aoff, aend, boff, bend, false });
+
+	intptr_t total_d = -1;
+
+	while (_steps.size() > base)
+	{
+		const ses_step step = _steps.back();
+		_steps.pop_back();
+
+		if (step.is_match)
+		{
+			_edit(diff_type::DIFF_MATCH, step.aoff, step.aend);
+			continue;
+		}
+
+		aoff = step.aoff;
+		aend = step.aend;
+		boff = step.boff;
+		bend = step.bend;
+
+		middle_snake ms = { 0 };
+		intptr_t d;
+
+		if (aend == 0)
+		{
+			_edit(diff_type::DIFF_IN_2, boff, bend);
+			d = bend;
+		}
+		else if (bend == 0)
+		{
+			_edit(diff_type::DIFF_IN_1, aoff, aend);
+			d = aend;
+		}
+		else
+		{
+			/* Find the middle "snake" around which we
+			 * solve the sub-problems.
+			 */
+			d = _find_middle_snake(aoff, aend, boff, bend, ms);
+			if (d == -1)
+			{
+				_steps.resize(base);
+				return -1;
 			}
 
-			// The whole match is contained at the end of the next diff -
-			// move the match down linking the surrounding diffs and matches
+			// Too different - a sub-problem's script cannot be left out so the whole compare is given up
+			if (d >= _dmax)
+			{
+				_steps.resize(base);
+				return _dmax;
+			}
 
-			// Link match to the next matching block
-			if (i + 2 < static_cast<intptr_t>(_diff.size()))
+			if (d > 1)
 			{
-				_diff[i + 2].off -= match.len;
-				_diff[i + 2].len += match.len;
+				// Pushed in reverse order - the part before the snake is solved first
+				_steps.push_back({ aoff + ms.u, aend - ms.u, boff + ms.v, bend - ms.v, false });
+				_steps.push_back({ aoff + ms.x, ms.u - ms.x, 0, 0, true });
+				_steps.push_back({ aoff, ms.x, boff, ms.y, false });
 			}
-			// Create new match block at the end
 			else
 			{
-				diff_info<UserDataT> end_match;
+				intptr_t x = ms.x;
+				intptr_t u = ms.u;
+
+				/* There are only 4 base cases when the
+				 * edit distance is 1.
+				 *
+				 * aend > bend   bend > aend
+				 *
+				 *   -       |
+				 *    \       \    x != u
+				 *     \       \
+				 *
+				 *   \       \
+				 *    \       \    x == u
+				 *     -       |
+				 */
+
+				if (bend > aend)
+				{
+					if (x == u)
+					{
+						_edit(diff_type::DIFF_MATCH, aoff, aend);
+						_edit(diff_type::DIFF_IN_2, boff + (bend - 1), 1);
+					}
+					else
+					{
+						_edit(diff_type::DIFF_IN_2, boff, 1);
+						_edit(diff_type::DIFF_MATCH, aoff, aend);
+					}
+				}
+				else
+				{
+					if (x == u)
+					{
+						_edit(diff_type::DIFF_MATCH, aoff, bend);
+						_edit(diff_type::DIFF_IN_1, aoff + (aend - 1), 1);
+					}
+					else
+					{
+						_edit(diff_type::DIFF_IN_1, aoff, 1);
+						_edit(diff_type::DIFF_MATCH, aoff + 1, bend);
+					}
+				}
+			}
+		}
+
+		if (total_d == -1)
+			total_d = d;
+	}
+
+	return total_d;
+}
+
+
+template <typename Elem, typename UserDataT>
+inline intptr_t DiffCalc<Elem, UserDataT>::_split_ses(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend)
+{
+#ifdef MULTITHREAD
+	if (_splits)
+		return _parallel_ses(aoff, aend, boff, bend, _splits);
+#endif
+
+	return _ses(aoff, aend, boff, bend);
+}
+
+
+#ifdef MULTITHREAD
+
+// Runs the tasks through the tasks runner if there is one. Otherwise the first task runs on the calling thread and
+// each of the others on a new thread (or after the first one if no thread can be created). The tasks must not throw
+template <typename Elem, typename UserDataT>
+void DiffCalc<Elem, UserDataT>::_run_tasks(int tasks_count, const std::function<void(int)>& task)
+{
+	if (_tasks_runner)
+	{
+		_tasks_runner(tasks_count, task);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+
+	int next_task = 1;
+
+	for (; next_task < tasks_count; ++next_task)
+	{
+		try
+		{
+			threads.emplace_back(task, next_task);
+		}
+		catch (...)
+		{
+			break;
+		}
+	}
+
+	task(0);
+
+	for (; next_task < tasks_count; ++next_task)
+		task(next_task);
+
+	for (auto& thread: threads)
+		thread.join();
+}
+
+
+// Same as _ses() but the sub-problems before and after the middle snake are solved as separate tasks (see
+// _run_tasks()) - the one after it on this DiffCalc and the one before it on a new one with a free workspace of the
+// thread running it, its edit script appended afterwards. Splits levels deep
+template <typename Elem, typename UserDataT>
+intptr_t DiffCalc<Elem, UserDataT>::_parallel_ses(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend,
+		int splits)
+{
+	// Smaller problems or problems with less differences are not worth a thread
+	static const intptr_t cMinSplitSize	= 1 << 12;
+	static const intptr_t cMinSplitD	= 64;
+
+	if (splits <= 0 || aend == 0 || bend == 0 || aend + bend < cMinSplitSize)
+		return _ses(aoff, aend, boff, bend);
+
+	middle_snake ms = { 0 };
+
+	const intptr_t d = _find_middle_snake(aoff, aend, boff, bend, ms);
+
+	if (d == -1)
+		return -1;
+
+	if (d >= _dmax)
+		return _dmax;
+
+	if (d < cMinSplitD)
+		return _ses(aoff, aend, boff, bend);
+
+	std::vector<diff_info<UserDataT>> leftDiff;
+	intptr_t leftD = -1;
+	bool leftApproximate = false;
+	std::exception_ptr leftException;
+
+	// The right part's script goes aside until the left one is done
+	std::vector<diff_info<UserDataT>> headDiff = std::move(_diff);
+	_diff.clear();
+
+	intptr_t rightD = -1;
+	std::exception_ptr rightException;
+
+	_run_tasks(2,
+		[&](int task)
+		{
+			if (task == 0)
+			{
+				try
+				{
+					rightD = _parallel_ses(aoff + ms.u, aend - ms.u, boff + ms.v, bend - ms.v, splits - 1);
+				}
+				catch (...)
+				{
+					rightException = std::current_exception();
+				}
+
+				return;
+			}
+
+			try
+			{
+				DiffWorkspace spareWorkspace;
+				DiffWorkspace& workspace = DiffWorkspace::free_local(spareWorkspace);
+				const DiffWorkspace::scoped_use use(workspace);
 
-				end_match.type = diff_type::DIFF_MATCH;
-				end_match.off = match.off + next_diff->len;
-				end_match.len = match.len;
+				DiffCalc left(_a, _a_size, _b, _b_size, _dmax, &workspace);
 
-				_diff.emplace_back(end_match);
+				left._vbuf			= left._ws.data();
+				left._vsize			= left._ws.size();
+				left._vmax			= _v_size(ms.x, ms.y);
+				left._cost_limit	= _cost_limit;
+				left._suffix_aoff	= _suffix_aoff;
+				left._suffix_boff	= _suffix_boff;
+				left._tasks_runner	= _tasks_runner;
+
+				leftD = left._parallel_ses(aoff, ms.x, boff, ms.y, splits - 1);
+				leftDiff = std::move(left._diff);
+				leftApproximate = left._approximate;
+
+				left._ws.trim();
+			}
+			catch (...)
+			{
+				leftException = std::current_exception();
 			}
+		});
+
+	if (leftException)
+		std::rethrow_exception(leftException);
+
+	if (rightException)
+		std::rethrow_exception(rightException);
+
+	std::vector<diff_info<UserDataT>> rightDiff = std::move(_diff);
+	_diff = std::move(headDiff);
+
+	if (leftD == -1 || rightD == -1)
+		return -1;
+
+	// As in _ses() - a part's script is not complete
+	if (leftD >= _dmax || rightD >= _dmax)
+		return _dmax;
+
+	if (leftApproximate)
+		_approximate = true;
+
+	for (const auto& di: leftDiff)
+		_edit(di.type, di.off, di.len);
+
+	_edit(diff_type::DIFF_MATCH, aoff + ms.x, ms.u - ms.x);
+
+	for (const auto& di: rightDiff)
+		_edit(di.type, di.off, di.len);
+
+	return d;
+}
+
+#endif // MULTITHREAD
+
+// Discards the elements without a counterpart in the other sequence, runs _ses() on what is left and maps the
+// edit script back to the original offsets. Compares the windows [off, off + asize) and [off, off + bsize) followed
+// by the common suffix of that size
+template <typename Elem, typename UserDataT>
+intptr_t DiffCalc<Elem, UserDataT>::_discarding_ses(intptr_t off, intptr_t asize, intptr_t bsize, intptr_t suffix,
+		std::true_type)
+{
+	const Elem* a = _a + off;
+	const Elem* b = _b + off;
+
+	const size_t idsCount = _ids_count(off, asize, bsize);
+
+	// Not dense class IDs - the presence table would be too big
+	if (!idsCount)
+		return _split_ses(off, asize + suffix, off, bsize + suffix);
+
+	// Bit 0 set if the element is present in a, bit 1 - in b
+	std::vector<uint8_t> presence(idsCount, 0);
+
+	// A given classes count must be above every element
+	for (intptr_t i = 0; i < asize + suffix; ++i)
+	{
+		assert(static_cast<size_t>(a[i]) < idsCount);
+		presence[a[i]] |= 1;
+	}
+
+	for (intptr_t i = 0; i < bsize + suffix; ++i)
+	{
+		assert(static_cast<size_t>(b[i]) < idsCount);
+		presence[b[i]] |= 2;
+	}
+
+	std::vector<Elem>		ra;
+	std::vector<Elem>		rb;
+	std::vector<intptr_t>	amap;
+	std::vector<intptr_t>	bmap;
+
+	for (intptr_t i = 0; i < asize; ++i)
+	{
+		if (presence[a[i]] == 3)
+		{
+			ra.push_back(a[i]);
+			amap.push_back(i);
+		}
+	}
+
+	for (intptr_t i = 0; i < bsize; ++i)
+	{
+		if (presence[b[i]] == 3)
+		{
+			rb.push_back(b[i]);
+			bmap.push_back(i);
+		}
+	}
+
+	const intptr_t rasize = static_cast<intptr_t>(ra.size());
+	const intptr_t rbsize = static_cast<intptr_t>(rb.size());
+
+	// Nothing to discard
+	if (rasize == asize && rbsize == bsize)
+		return _split_ses(off, asize + suffix, off, bsize + suffix);
+
+	// Run the search on the reduced sequences collecting its script aside
+	std::vector<diff_info<UserDataT>> rdiff = std::move(_diff);
+	_diff.clear();
+
+	const Elem* origA = _a;
+	const Elem* origB = _b;
+
+	const intptr_t suffixAoff = _suffix_aoff;
+	const intptr_t suffixBoff = _suffix_boff;
+
+	// The reduced sequences are compared without the suffix
+	_a = ra.data();
+	_b = rb.data();
+	_suffix_aoff = -1;
+	_suffix_boff = -1;
 
-			next_diff->off -= match.len;
+	// _ses() must begin with a diff
+	const intptr_t roff = diff_match_run<Elem>::forward(_a, _b, (rasize < rbsize) ? rasize : rbsize);
 
-			_diff.erase(_diff.begin() + i);
+	_edit(diff_type::DIFF_MATCH, 0, roff);
 
-			next_diff = &_diff[i];
+	intptr_t d = 0;
 
-			intptr_t k = i - 1;
+	if (roff < rasize || roff < rbsize)
+		d = _split_ses(roff, rasize - roff, roff, rbsize - roff);
 
-			diff_info<UserDataT>* prev_diff = &_diff[k];
+	_a = origA;
+	_b = origB;
+	_suffix_aoff = suffixAoff;
+	_suffix_boff = suffixBoff;
 
-			if (next_diff->type != prev_diff->type)
+	std::swap(rdiff, _diff);
+
+	if (d == -1)
+		return -1;
+
+	// Changed flags padded with an unchanged sentinel at both ends
+	std::vector<char> achanged(asize + 2, 1);
+	std::vector<char> bchanged(bsize + 2, 1);
+
+	achanged.front() = achanged.back() = 0;
+	bchanged.front() = bchanged.back() = 0;
+
+	intptr_t bpos = 0;
+
+	for (const auto& di: rdiff)
+	{
+		if (di.type == diff_type::DIFF_MATCH)
+		{
+			for (intptr_t k = 0; k < di.len; ++k)
 			{
-				if ((k > 0) && (_diff[k - 1].type == next_diff->type))
-					prev_diff = &_diff[--k];
+				achanged[amap[di.off + k] + 1] = 0;
+				bchanged[bmap[bpos + k] + 1] = 0;
 			}
 
-			// Merge diffs
-			if (next_diff->type == prev_diff->type)
+			bpos += di.len;
+		}
+		else if (di.type == diff_type::DIFF_IN_2)
+		{
+			bpos += di.len;
+		}
+	}
+
+	// The discarded elements split the changes of the reduced script - merge and align them back
+	_slide_changes(achanged.data() + 1, bchanged.data() + 1, a, asize);
+	_slide_changes(bchanged.data() + 1, achanged.data() + 1, b, bsize);
+
+	const char* ach = achanged.data() + 1;
+	const char* bch = bchanged.data() + 1;
+
+	// Unchanged elements pair up in order - rebuild the script on the original offsets
+	intptr_t i = 0;
+	intptr_t j = 0;
+
+	while (i < asize || j < bsize)
+	{
+		intptr_t start = i;
+
+		while (i < asize && ach[i])
+			++i;
+
+		_edit(diff_type::DIFF_IN_1, off + start, i - start);
+
+		start = j;
+
+		while (j < bsize && bch[j])
+			++j;
+
+		_edit(diff_type::DIFF_IN_2, off + start, j - start);
+
+		start = i;
+
+		while (i < asize && j < bsize && !ach[i] && !bch[j])
+		{
+			++i;
+			++j;
+		}
+
+		_edit(diff_type::DIFF_MATCH, off + start, i - start);
+	}
+
+	_edit(diff_type::DIFF_MATCH, off + asize, suffix);
+
+	return d + (asize - rasize) + (bsize - rbsize);
+}
+
+
+// GNU diff's shift_boundaries(): slides each run of changed elements over equal neighbours to merge it with
+// the adjacent runs and then as far down as possible, preferring a position aligned with a change in the other
+// sequence. changed and other_changed must have an unchanged sentinel at index -1 and at their size
+template <typename Elem, typename UserDataT>
+void DiffCalc<Elem, UserDataT>::_slide_changes(char* changed, const char* other_changed, const Elem* el,
+		intptr_t size)
+{
+	intptr_t i = 0;
+	intptr_t j = 0;
+
+	while (true)
+	{
+		// Find the next run of changes and the corresponding point in the other sequence
+		while (i < size && !changed[i])
+		{
+			while (other_changed[j++]);
+			++i;
+		}
+
+		if (i == size)
+			break;
+
+		intptr_t start = i;
+
+		while (changed[++i]);
+		while (other_changed[j])
+			++j;
+
+		intptr_t runlength;
+		intptr_t corresponding;
+
+		do
+		{
+			runlength = i - start;
+
+			// Move the run up while the previous unchanged element matches its last one
+			while (start && el[start - 1] == el[i - 1])
 			{
-				prev_diff->len += next_diff->len;
+				changed[--start] = 1;
+				changed[--i] = 0;
+
+				while (changed[start - 1])
+					--start;
 
-				_diff.erase(_diff.begin() + i);
-				--i;
+				while (other_changed[--j]);
 			}
-			// Swap diffs to represent block replacement (DIFF_IN_1 followed by DIFF_IN_2)
-			else if (next_diff->type == diff_type::DIFF_IN_1)
+
+			corresponding = other_changed[j - 1] ? i : size;
+
+			// Move the run down while its first element matches the next unchanged one
+			while (i != size && el[start] == el[i])
 			{
-				std::swap(*prev_diff, *next_diff);
+				changed[start++] = 0;
+				changed[i++] = 1;
+
+				while (changed[i])
+					++i;
+
+				while (other_changed[++j])
+					corresponding = i;
 			}
+		}
+		while (runlength != i - start);
 
-			// Check if previous match is suitable for combining
-			if (k > 1)
-				i = k - 2;
+		// Move the merged run back up to the last place aligned with changes in the other sequence
+		while (corresponding < i)
+		{
+			changed[--start] = 1;
+			changed[--i] = 0;
+
+			while (other_changed[--j]);
 		}
 	}
 }
 
 
+template <typename Elem, typename UserDataT>
+inline intptr_t DiffCalc<Elem, UserDataT>::_discarding_ses(intptr_t off, intptr_t asize, intptr_t bsize,
+		intptr_t suffix, std::false_type)
+{
+	return _split_ses(off, asize + suffix, off, bsize + suffix);
+}
+
+
+// Histogram diff (as JGit's and git's --histogram): anchors on the lowest occurrence common run of the a region,
+// recurses on both sides of it and falls back to _ses() for small regions or regions without anchors.
+// Compares the windows [off, off + asize) and [off, off + bsize) (they must begin and end with a diff) followed by
+// the common suffix of that size - the untrimmed windows' suffix would be matched first as any region's
+template <typename Elem, typename UserDataT>
+intptr_t DiffCalc<Elem, UserDataT>::_histogram_ses(intptr_t off, intptr_t asize, intptr_t bsize, intptr_t suffix,
+		std::true_type)
+{
+	// Regions up to that size are left to Myers' algorithm
+	static const intptr_t cMyersMaxSize = 64;
+	// Elements occurring more often in the a region are not used as anchors
+	static const intptr_t cMaxOccurrences = 64;
+
+	const size_t idsCount = _ids_count(off, asize, bsize);
+
+	// Not dense class IDs - the histogram would be too big
+	if (!idsCount)
+		return _split_ses(off, asize + suffix, off, bsize + suffix);
+
+	// Occurrences count and last occurrence of each element in the current a region
+	std::vector<intptr_t> counts(idsCount, 0);
+	std::vector<intptr_t> lastOcc(idsCount, -1);
+	// Previous occurrence of the same element in the current a region
+	std::vector<intptr_t> prevOcc(asize);
+
+	struct hist_region {
+		intptr_t aoff, aend, boff, bend;
+		bool is_match;
+	};
+
+	// Regions and anchor matches left to be processed - the top one is next in the edit script
+	std::vector<hist_region> stack;
+
+	stack.push_back({ off, off + asize, off, off + bsize, false });
+
+	intptr_t d = 0;
+
+	while (!stack.empty())
+	{
+		hist_region r = stack.back();
+		stack.pop_back();
+
+		if (r.is_match)
+		{
+			_edit(diff_type::DIFF_MATCH, r.aoff, r.aend - r.aoff);
+			continue;
+		}
+
+		const intptr_t prefix = diff_match_run<Elem>::forward(_a + r.aoff, _b + r.boff,
+				((r.aend - r.aoff) < (r.bend - r.boff)) ? (r.aend - r.aoff) : (r.bend - r.boff));
+
+		_edit(diff_type::DIFF_MATCH, r.aoff, prefix);
+
+		r.aoff += prefix;
+		r.boff += prefix;
+
+		const intptr_t suffix = diff_match_run<Elem>::backward(_a + r.aend, _b + r.bend,
+				((r.aend - r.aoff) < (r.bend - r.boff)) ? (r.aend - r.aoff) : (r.bend - r.boff));
+
+		r.aend -= suffix;
+		r.bend -= suffix;
+
+		if (suffix)
+			stack.push_back({ r.aend, r.aend + suffix, r.bend, r.bend + suffix, true });
+
+		const intptr_t alen = r.aend - r.aoff;
+		const intptr_t blen = r.bend - r.boff;
+
+		hist_region anchor = { 0, 0, 0, 0, true };
+
+		if (alen && blen && alen + blen > cMyersMaxSize)
+		{
+			for (intptr_t i = r.aoff; i < r.aend; ++i)
+			{
+				const Elem e = _a[i];
+
+				prevOcc[i - off] = lastOcc[e];
+				lastOcc[e] = i;
+				++counts[e];
+			}
+
+			intptr_t anchorCount = cMaxOccurrences + 1;
+
+			for (intptr_t j = r.boff; j < r.bend;)
+			{
+				const intptr_t count = counts[_b[j]];
+				intptr_t nextJ = j + 1;
+
+				if (count && count <= anchorCount)
+				{
+					for (intptr_t i = lastOcc[_b[j]]; i >= 0; i = prevOcc[i - off])
+					{
+						const intptr_t back = diff_match_run<Elem>::backward(_a + i, _b + j,
+								((i - r.aoff) < (j - r.boff)) ? (i - r.aoff) : (j - r.boff));
+						const intptr_t fwd = diff_match_run<Elem>::forward(_a + i, _b + j,
+								((r.aend - i) < (r.bend - j)) ? (r.aend - i) : (r.bend - j));
+
+						if (nextJ < j + fwd)
+							nextJ = j + fwd;
+
+						intptr_t runCount = count;
+
+						for (intptr_t k = i - back; k < i + fwd; ++k)
+							if (runCount > counts[_a[k]])
+								runCount = counts[_a[k]];
+
+						if (runCount < anchorCount || (runCount == anchorCount &&
+								back + fwd > anchor.aend - anchor.aoff))
+						{
+							anchorCount = runCount;
+
+							anchor.aoff = i - back;
+							anchor.aend = i + fwd;
+							anchor.boff = j - back;
+							anchor.bend = j + fwd;
+						}
+					}
+				}
+
+				j = nextJ;
+			}
+
+			for (intptr_t i = r.aoff; i < r.aend; ++i)
+			{
+				counts[_a[i]] = 0;
+				lastOcc[_a[i]] = -1;
+			}
+		}
+
+		if (anchor.aend == anchor.aoff)
+		{
+			const intptr_t rd = _split_ses(r.aoff, alen, r.boff, blen);
+
+			if (rd == -1)
+			{
+				d = -1;
+				break;
+			}
+
+			d += rd;
+
+			if (d >= _dmax)
+			{
+				d = _dmax;
+				break;
+			}
+
+			continue;
+		}
+
+		stack.push_back({ anchor.aend, r.aend, anchor.bend, r.bend, false });
+		stack.push_back(anchor);
+		stack.push_back({ r.aoff, anchor.aoff, r.boff, anchor.boff, false });
+	}
+
+	if (d != -1)
+		_edit(diff_type::DIFF_MATCH, off + asize, suffix);
+
+	return d;
+}
+
+
+template <typename Elem, typename UserDataT>
+inline intptr_t DiffCalc<Elem, UserDataT>::_histogram_ses(intptr_t off, intptr_t asize, intptr_t bsize,
+		intptr_t suffix, std::false_type)
+{
+	return _split_ses(off, asize + suffix, off, bsize + suffix);
+}
+
+
+// Compares the windows [off, off + asize) and [off, off + bsize) followed by the common suffix of that size with the
+// selected algorithm. Myers' search runs on the untrimmed windows - its snakes skip the suffix (see _forward_run())
+template <typename Elem, typename UserDataT>
+inline intptr_t DiffCalc<Elem, UserDataT>::_window_ses(intptr_t off, intptr_t asize, intptr_t bsize,
+		intptr_t suffix, bool doDiscardUnmatched, diff_algorithm algorithm)
+{
+	using dense_ids = std::integral_constant<bool, std::is_integral<Elem>::value && std::is_unsigned<Elem>::value>;
+
+	// Elements without a counterpart never become histogram anchors - no need to discard them
+	if (algorithm == diff_algorithm::HISTOGRAM)
+		return _histogram_ses(off, asize, bsize, suffix, dense_ids());
+
+	if (doDiscardUnmatched)
+		return _discarding_ses(off, asize, bsize, suffix, dense_ids());
+
+	return _split_ses(off, asize + suffix, off, bsize + suffix);
+}
+
+
+// If a whole matching block is contained at the end of the next diff block shift match down:
+// If [] surrounds the marked differences, basically [abc]d[efgd]hi is the same as [abcdefg]dhi
+// We combine diffs to make results more compact and clean
+// The diffs are compacted in place in a single sweep - [0, w) are the checked diffs and [r, size) the ones left.
+// After a combine the last few checked diffs are moved back to be checked again
+template <typename Elem, typename UserDataT>
+void DiffCalc<Elem, UserDataT>::_combine_diffs()
+{
+	intptr_t w = 0;
+	intptr_t r = 0;
+
+	auto size = [this]() { return static_cast<intptr_t>(_diff.size()); };
+
+	auto skip =
+		[&](intptr_t count)
+		{
+			for (; count > 0 && r < size(); --count, ++w, ++r)
+			{
+				if (w != r)
+					_diff[w] = std::move(_diff[r]);
+			}
+		};
+
+	// The first diff is never a match to combine
+	skip(1);
+
+	while (r < size())
+	{
+		if (_diff[r].type != diff_type::DIFF_MATCH || r + 1 == size())
+		{
+			skip(1);
+			continue;
+		}
+
+		const Elem*	el	= _b;
+
+		if (_diff[r + 1].type == diff_type::DIFF_IN_1)
+		{
+			// If there is DIFF_IN_2 after DIFF_IN_1 both sequences are changed - diff endings don't match for sure
+			if ((r + 2 < size()) && (_diff[r + 2].type == diff_type::DIFF_IN_2))
+			{
+				skip(3);
+				continue;
+			}
+
+			el	= _a;
+		}
+
+		const diff_info<UserDataT>& match = _diff[r];
+		const diff_info<UserDataT>& next_diff = _diff[r + 1];
+
+		if (match.len > next_diff.len)
+		{
+			skip(2);
+			continue;
+		}
+
+		intptr_t match_len = match.len;
+
+		intptr_t match_off = next_diff.off - 1;
+		intptr_t check_off = next_diff.off + next_diff.len - 1;
+
+		while ((match_len > 0) && (el[match_off] == el[check_off]))
+		{
+			--match_off;
+			--check_off;
+			--match_len;
+		}
+
+		if (match_len > 0)
+		{
+			skip(2);
+			continue;
+		}
+
+		// The whole match is contained at the end of the next diff -
+		// move the match down linking the surrounding diffs and matches
+
+		match_len = match.len;
+
+		// Link match to the next matching block
+		if (r + 2 < size())
+		{
+			_diff[r + 2].off -= match_len;
+			_diff[r + 2].len += match_len;
+		}
+		// Create new match block at the end
+		else
+		{
+			diff_info<UserDataT> end_match;
+
+			end_match.type = diff_type::DIFF_MATCH;
+			end_match.off = match.off;
+
+			if (next_diff.type == diff_type::DIFF_IN_1)
+				end_match.off += next_diff.len;
+
+			end_match.len = match_len;
+
+			// Might reallocate the diffs
+			_diff.emplace_back(end_match);
+		}
+
+		_diff[r + 1].off -= match_len;
+
+		// Drop the match - the next diff is the one to check now
+		++r;
+
+		intptr_t k = w - 1;
+
+		if (_diff[r].type != _diff[k].type)
+		{
+			if ((k > 0) && (_diff[k - 1].type == _diff[r].type))
+				--k;
+		}
+
+		bool merged = false;
+
+		// Merge diffs
+		if (_diff[r].type == _diff[k].type)
+		{
+			_diff[k].len += _diff[r].len;
+			++r;
+			merged = true;
+		}
+		// Swap diffs to represent block replacement (DIFF_IN_1 followed by DIFF_IN_2)
+		else if (_diff[r].type == diff_type::DIFF_IN_1)
+		{
+			std::swap(_diff[k], _diff[r]);
+		}
+
+		// Check if previous match is suitable for combining
+		if (k > 1)
+		{
+			while (w > k - 1)
+			{
+				--w;
+				--r;
+
+				if (w != r)
+					_diff[r] = std::move(_diff[w]);
+			}
+		}
+		else if (!merged)
+		{
+			skip(1);
+		}
+	}
+
+	_diff.erase(_diff.begin() + w, _diff.end());
+}
+
+
 // Algorithm borrowed from WinMerge
 // If the Elem after the DIFF_IN_1 is the same as the first Elem of the DIFF_IN_1, shift differences down:
 // If [] surrounds the marked differences, basically [abb]a is the same as a[bba]
 // Since most languages start with unique elem and end with repetitive elem (end, </node>, }, ], ), >, etc)
 // we shift the differences down to make results look cleaner
+// The diffs are compacted in place in a single sweep as in _combine_diffs()
 template <typename Elem, typename UserDataT>
 void DiffCalc<Elem, UserDataT>::_shift_boundaries()
 {
-	for (intptr_t i = 0; i < static_cast<intptr_t>(_diff.size()); ++i)
+	intptr_t w = 0;
+	intptr_t r = 0;
+
+	auto size = [this]() { return static_cast<intptr_t>(_diff.size()); };
+
+	auto skip =
+		[&](intptr_t count)
+		{
+			for (; count > 0 && r < size(); --count, ++w, ++r)
+			{
+				if (w != r)
+					_diff[w] = std::move(_diff[r]);
+			}
+		};
+
+	// Drops the diff after the checked one
+	auto drop_next =
+		[&]()
+		{
+			_diff[r + 1] = std::move(_diff[r]);
+			++r;
+		};
+
+	while (r < size())
 	{
-		if (_diff[i].type == diff_type::DIFF_MATCH)
+		if (_diff[r].type == diff_type::DIFF_MATCH)
+		{
+			skip(1);
 			continue;
+		}
 
 		const Elem*	el	= _b;
 
-		if (_diff[i].type == diff_type::DIFF_IN_1)
+		if (_diff[r].type == diff_type::DIFF_IN_1)
 		{
 			// If there is DIFF_IN_2 after DIFF_IN_1 both sequences are changed - boundaries do not match for sure
-			if ((i + 1 < static_cast<intptr_t>(_diff.size())) && (_diff[i + 1].type == diff_type::DIFF_IN_2))
+			if ((r + 1 < size()) && (_diff[r + 1].type == diff_type::DIFF_IN_2))
 			{
-				++i;
+				skip(2);
 				continue;
 			}
 
 			el	= _a;
 		}
+		// Same for DIFF_IN_2 right after DIFF_IN_1 (the match between them has been shifted away)
+		else if ((w > 0) && (_diff[w - 1].type == diff_type::DIFF_IN_1))
+		{
+			skip(1);
+			continue;
+		}
 
-		if (i + 1 < static_cast<intptr_t>(_diff.size()))
+		if (r + 1 == size())
 		{
-			diff_info<UserDataT>& diff = _diff[i];
-			diff_info<UserDataT>* next_match_diff = &_diff[i + 1];
+			skip(1);
+			continue;
+		}
+
+		diff_info<UserDataT>& diff = _diff[r];
+		const intptr_t next_len = _diff[r + 1].len;
+
+		const intptr_t max_len = (diff.len > next_len) ? next_len : diff.len;
 
-			const intptr_t max_len = (diff.len > next_match_diff->len) ? next_match_diff->len : diff.len;
+		intptr_t check_off = diff.off + diff.len;
+		intptr_t shift_len = 0;
 
-			intptr_t check_off = diff.off + diff.len;
-			intptr_t shift_len = 0;
+		while (shift_len < max_len && el[diff.off] == el[check_off])
+		{
+			++diff.off;
+			++check_off;
+			++shift_len;
+		}
 
-			while (shift_len < max_len && el[diff.off] == el[check_off])
+		// Diff block shifted - we need to adjust the surrounding matching blocks accordingly
+		if (shift_len)
+		{
+			if (w > 0)
 			{
-				++diff.off;
-				++check_off;
-				++shift_len;
+				_diff[w - 1].len += shift_len;
 			}
-
-			// Diff block shifted - we need to adjust the surrounding matching blocks accordingly
-			if (shift_len)
+			// Create new match block in the beginning
+			else
 			{
-				if (i > 0)
+				diff_info<UserDataT> prev_match_diff;
+
+				prev_match_diff.type = diff_type::DIFF_MATCH;
+				prev_match_diff.off = 0;
+				prev_match_diff.len = shift_len;
+
+				// There is no free slot only if this is the first diff
+				if (r == 0)
 				{
-					_diff[i - 1].len += shift_len;
+					_diff.insert(_diff.begin(), prev_match_diff);
+					++r;
 				}
-				// Create new match block in the beginning
 				else
 				{
-					diff_info<UserDataT> prev_match_diff;
-
-					prev_match_diff.type = diff_type::DIFF_MATCH;
-					prev_match_diff.off = 0;
-					prev_match_diff.len = shift_len;
-
-					_diff.insert(_diff.begin(), prev_match_diff);
-					++i;
+					_diff[0] = prev_match_diff;
 				}
 
-				next_match_diff = &_diff[i + 1];
+				w = 1;
+			}
 
-				next_match_diff->off += shift_len;
-				next_match_diff->len -= shift_len;
+			diff_info<UserDataT>& next_match_diff = _diff[r + 1];
 
-				// The whole match diff shifted - erase it and merge surrounding diff blocks
-				if (next_match_diff->len == 0)
-				{
-					intptr_t j = i + 1;
+			next_match_diff.off += shift_len;
+			next_match_diff.len -= shift_len;
 
-					_diff.erase(_diff.begin() + j);
+			// The whole match diff shifted - erase it and merge surrounding diff blocks
+			if (next_match_diff.len == 0)
+			{
+				drop_next();
 
-					if (j < static_cast<intptr_t>(_diff.size()) && _diff[i].type == _diff[j].type)
+				if (r + 1 < size())
+				{
+					if (_diff[r].type == _diff[r + 1].type)
 					{
-						_diff[i].len += _diff[j].len;
-						_diff.erase(_diff.begin() + j);
+						_diff[r].len += _diff[r + 1].len;
+						drop_next();
 
 						// Diff blocks merged - recheck same diff
-						--i;
+						continue;
+					}
+					// Keep block replacement order (DIFF_IN_1 followed by DIFF_IN_2)
+					else if (_diff[r].type == diff_type::DIFF_IN_2)
+					{
+						std::swap(_diff[r], _diff[r + 1]);
 					}
 				}
 			}
 		}
+
+		skip(1);
 	}
+
+	_diff.erase(_diff.begin() + w, _diff.end());
+}
+
+
+// Compares the trimmed windows [off, off + asize) and [off, off + bsize) and adds the matching prefix and the common
+// suffix of that size. The script must be empty
+template <typename Elem, typename UserDataT>
+intptr_t DiffCalc<Elem, UserDataT>::_window_diff(intptr_t off, intptr_t asize, intptr_t bsize, intptr_t suffix,
+		bool doDiscardUnmatched, diff_algorithm algorithm)
+{
+	_edit(diff_type::DIFF_MATCH, 0, off);
+
+	return _window_ses(off, asize, bsize, suffix, doDiscardUnmatched, algorithm);
 }
 
 
 template <typename Elem, typename UserDataT>
-inline intptr_t DiffCalc<Elem, UserDataT>::_count_replaces()
+inline intptr_t DiffCalc<Elem, UserDataT>::count_replaces(const std::vector<diff_info<UserDataT>>& diff)
 {
-	const intptr_t diffSize = static_cast<intptr_t>(_diff.size()) - 1;
+	const intptr_t diffSize = static_cast<intptr_t>(diff.size()) - 1;
 	intptr_t replaces = 0;
 
 	for (intptr_t i = 0; i < diffSize; ++i)
 	{
-		if ((_diff[i].type == diff_type::DIFF_IN_1) && (_diff[i + 1].type == diff_type::DIFF_IN_2))
+		if ((diff[i].type == diff_type::DIFF_IN_1) && (diff[i + 1].type == diff_type::DIFF_IN_2))
 		{
 			++replaces;
 			++i;
@@ -586,7 +1911,63 @@ inline intptr_t DiffCalc<Elem, UserDataT>::_count_replaces()
 
 template <typename Elem, typename UserDataT>
 std::pair<std::vector<diff_info<UserDataT>>, bool> DiffCalc<Elem, UserDataT>::operator()(bool doDiffsCombine,
-		bool doBoundaryShift)
+		bool doBoundaryShift, bool doDiscardUnmatched, diff_algorithm algorithm)
+{
+	const bool swapped = _compare(doDiffsCombine, doBoundaryShift, doDiscardUnmatched, algorithm);
+
+	return std::make_pair(std::move(_diff), swapped);
+}
+
+
+template <typename Elem, typename UserDataT>
+template <typename Visitor>
+bool DiffCalc<Elem, UserDataT>::visit(Visitor&& visitor, bool doDiffsCombine, bool doBoundaryShift,
+		bool doDiscardUnmatched, diff_algorithm algorithm)
+{
+	// Keeps the diffs storage of the thread's previous calls unless it has grown too big to be kept
+	static thread_local std::vector<diff_info<UserDataT>> diffsBuf;
+
+	static const size_t cMaxKeptDiffs = 1 << 16;
+
+	auto releaseBuf =
+		[this]()
+		{
+			_diff.clear();
+			_diff.swap(diffsBuf);
+
+			if (diffsBuf.capacity() > cMaxKeptDiffs)
+				std::vector<diff_info<UserDataT>>().swap(diffsBuf);
+		};
+
+	_diff.swap(diffsBuf);
+	_diff.clear();
+
+	bool swapped = false;
+
+	try
+	{
+		swapped = _compare(doDiffsCombine, doBoundaryShift, doDiscardUnmatched, algorithm);
+
+		for (const auto& di: _diff)
+			visitor(di, swapped);
+	}
+	catch (...)
+	{
+		releaseBuf();
+
+		throw;
+	}
+
+	releaseBuf();
+
+	return swapped;
+}
+
+
+// Leaves the differences in _diff and returns the swap flag
+template <typename Elem, typename UserDataT>
+bool DiffCalc<Elem, UserDataT>::_compare(bool doDiffsCombine, bool doBoundaryShift, bool doDiscardUnmatched,
+		diff_algorithm algorithm)
 {
 	bool swapped = (_a_size > _b_size);
 
@@ -596,70 +1977,187 @@ std::pair<std::vector<diff_info<UserDataT>>, bool> DiffCalc<Elem, UserDataT>::op
 		std::swap(_a_size, _b_size);
 	}
 
-	/* The _ses function assumes we begin with a diff. The following ensures this is true by skipping any matches
-	 * in the beginning. This also helps to quickly process sequences that match entirely.
-	 */
-	intptr_t off = 0;
+	// Parallel parts of the compare running on this thread must not use the workspace too
+	const DiffWorkspace::scoped_use use(_ws);
 
+	/* The _ses function assumes we begin and end with a diff. The following ensures this is true by skipping any
+	 * matches in the beginning and in the end. This also helps to quickly process sequences that match entirely
+	 * or differ in a small part only.
+	 */
 	intptr_t asize = _a_size;
 	intptr_t bsize = _b_size;
 
-	while (off < asize && off < bsize && _a[off] == _b[off])
-		++off;
-
-	_edit(diff_type::DIFF_MATCH, 0, off);
+	const intptr_t off = diff_match_run<Elem>::forward(_a, _b, (asize < bsize) ? asize : bsize);
 
 	if (asize == bsize && off == asize)
-		return std::make_pair(_diff, swapped);
+	{
+		_edit(diff_type::DIFF_MATCH, 0, off);
+		return swapped;
+	}
 
 	asize -= off;
 	bsize -= off;
 
-	if (_ses(off, asize, off, bsize) == -1)
+	const intptr_t suffix =
+			diff_match_run<Elem>::backward(_a + off + asize, _b + off + bsize, (asize < bsize) ? asize : bsize);
+
+	asize -= suffix;
+	bsize -= suffix;
+
+	_suffix_aoff	= suffix ? off + asize : -1;
+	_suffix_boff	= suffix ? off + bsize : -1;
+
+	_vbuf	= _ws.data();
+	_vsize	= _ws.size();
+	_vmax	= _v_size(asize, bsize);
+
+	_approximate = false;
+
+	if (_bounded_cost)
 	{
-		_diff.clear();
-		return std::make_pair(_diff, swapped);
+		// About the square root of the untrimmed window's diagonals count but not too small (as GNU diff)
+		_cost_limit = 1;
+
+		for (intptr_t diags = asize + bsize + 2 * suffix + 3; diags; diags >>= 2)
+			_cost_limit <<= 1;
+
+		if (_cost_limit < 4096)
+			_cost_limit = 4096;
 	}
 
-	// Wipe temporal buffer to free memory
-	_buf.get().clear();
+	// Equal sized sequences are compared swapped as well to see if the result is more optimal
+	const bool checkSwapped = (_a_size == _b_size && _orientation != diff_orientation::SINGLE);
+
+	std::vector<diff_info<UserDataT>> swappedDiff;
+	intptr_t swappedD = -1;
+	bool swappedApproximate = false;
+	bool swappedDone = false;
 
-	// Swap compared sequences and re-compare to see if result is more optimal
-	if (_a_size == _b_size)
+	intptr_t d = -1;
+
+#ifdef MULTITHREAD
+	if (checkSwapped && _orientation == diff_orientation::CHECK_BOTH_CONCURRENTLY)
 	{
-		const intptr_t replacesCount = _count_replaces();
+		// _a, _b and the suffix offsets might be temporarily replaced during the compare
+		const Elem* const a = _a;
+		const Elem* const b = _b;
+		const intptr_t suffixAoff = _suffix_aoff;
+		const intptr_t suffixBoff = _suffix_boff;
+
+		std::exception_ptr exception;
+		std::exception_ptr swappedException;
+
+		// Both orientations are compared as separate tasks - the swapped one on a new DiffCalc with a free workspace
+		// of the thread running it
+		_run_tasks(2,
+			[&, a, b, suffixAoff, suffixBoff](int task)
+			{
+				if (task == 0)
+				{
+					try
+					{
+						d = _window_diff(off, asize, bsize, suffix, doDiscardUnmatched, algorithm);
+					}
+					catch (...)
+					{
+						exception = std::current_exception();
+					}
+
+					return;
+				}
+
+				try
+				{
+					DiffWorkspace spareWorkspace;
+					DiffWorkspace& workspace = DiffWorkspace::free_local(spareWorkspace);
+					const DiffWorkspace::scoped_use use(workspace);
+
+					DiffCalc swappedCalc(b, _b_size, a, _a_size, _dmax, &workspace);
+
+					swappedCalc._vbuf			= swappedCalc._ws.data();
+					swappedCalc._vsize			= swappedCalc._ws.size();
+					swappedCalc._vmax			= _vmax;
+					swappedCalc._splits			= _splits;
+					swappedCalc._cost_limit		= _cost_limit;
+					swappedCalc._classes_count	= _classes_count;
+					swappedCalc._suffix_aoff	= suffixBoff;
+					swappedCalc._suffix_boff	= suffixAoff;
+					swappedCalc._tasks_runner	= _tasks_runner;
 
-		// Store current compare result
+					swappedD = swappedCalc._window_diff(off, asize, bsize, suffix, doDiscardUnmatched, algorithm);
+					swappedDiff = std::move(swappedCalc._diff);
+
+					swappedApproximate = swappedCalc._approximate;
+
+					swappedCalc._ws.trim();
+				}
+				catch (...)
+				{
+					swappedException = std::current_exception();
+				}
+			});
+
+		if (exception)
+			std::rethrow_exception(exception);
+
+		if (swappedException)
+			std::rethrow_exception(swappedException);
+
+		swappedDone = true;
+	}
+	else
+#endif
+	{
+		d = _window_diff(off, asize, bsize, suffix, doDiscardUnmatched, algorithm);
+	}
+
+	// Too different (or failed)
+	const bool aborted = (d == -1 || d >= _dmax);
+
+	if (checkSwapped && !swappedDone && !aborted)
+	{
 		std::vector<diff_info<UserDataT>> storedDiff = std::move(_diff);
+		_diff.clear();
+
+		// Each orientation reports whether its own script is approximate
+		const bool approximate = _approximate;
+		_approximate = false;
+
 		std::swap(_a, _b);
-		swapped = !swapped;
 
-		// Restore first matching block before continuing
-		if (storedDiff[0].type == diff_type::DIFF_MATCH)
-			_diff.push_back(storedDiff[0]);
+		swappedD = _window_diff(off, asize, bsize, suffix, doDiscardUnmatched, algorithm);
+		swappedDiff = std::move(_diff);
+		swappedApproximate = _approximate;
 
-		intptr_t newReplacesCount = _ses(off, asize, off, bsize);
+		std::swap(_a, _b);
 
-		// Wipe temporal buffer to free memory
-		_buf.get().clear();
+		_diff = std::move(storedDiff);
+		_approximate = approximate;
+	}
 
-		if (newReplacesCount != -1)
-			newReplacesCount = _count_replaces();
+	if (aborted)
+	{
+		_ws.trim();
+		_diff.clear();
+		return swapped;
+	}
 
-		// If re-compare result is not more optimal - restore the previous state
-		if (newReplacesCount < replacesCount)
-		{
-			_diff = std::move(storedDiff);
-			std::swap(_a, _b);
-			swapped = !swapped;
-		}
+	// Keep the swapped compare result if it is not less optimal
+	if (checkSwapped && swappedD != -1 && swappedD < _dmax && count_replaces(swappedDiff) >= count_replaces(_diff))
+	{
+		_diff = std::move(swappedDiff);
+		_approximate = swappedApproximate;
+		std::swap(_a, _b);
+		swapped = !swapped;
 	}
 
+	_ws.trim();
+
 	if (doDiffsCombine)
 		_combine_diffs();
 
 	if (doBoundaryShift)
 		_shift_boundaries();
 
-	return std::make_pair(_diff, swapped);
+	return swapped;
 }
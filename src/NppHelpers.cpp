@@ -535,27 +535,6 @@ std::vector<char> getText(int view, intptr_t startPos, intptr_t endPos)
 }
 
 
-void toLowerCase(std::vector<char>& text)
-{
-	const int len = static_cast<int>(text.size());
-
-	if (len == 0)
-		return;
-
-	const int wLen = ::MultiByteToWideChar(CP_UTF8, 0, text.data(), len, NULL, 0);
-
-	std::vector<wchar_t> wText(wLen);
-
-	::MultiByteToWideChar(CP_UTF8, 0, text.data(), len, wText.data(), wLen);
-
-	wText.push_back(L'\0');
-	::CharLowerW((LPWSTR)wText.data());
-	wText.pop_back();
-
-	::WideCharToMultiByte(CP_UTF8, 0, wText.data(), wLen, text.data(), len, NULL, NULL);
-}
-
-
 void clearWindow(int view)
 {
 	CallScintilla(view, SCI_FOLDALL, SC_FOLDACTION_EXPAND, 0);
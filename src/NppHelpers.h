@@ -24,65 +24,9 @@
 #include <utility>
 
 #include "Compare.h"
+#include "Markers.h"
 
 
-enum Marker_t
-{
-	MARKER_CHANGED_LINE = 0,
-	MARKER_ADDED_LINE,
-	MARKER_REMOVED_LINE,
-	MARKER_MOVED_LINE,
-	MARKER_BLANK,
-	MARKER_CHANGED_SYMBOL,
-	MARKER_CHANGED_LOCAL_SYMBOL,
-	MARKER_ADDED_SYMBOL,
-	MARKER_ADDED_LOCAL_SYMBOL,
-	MARKER_REMOVED_SYMBOL,
-	MARKER_REMOVED_LOCAL_SYMBOL,
-	MARKER_MOVED_LINE_SYMBOL,
-	MARKER_MOVED_BLOCK_BEGIN_SYMBOL,
-	MARKER_MOVED_BLOCK_MID_SYMBOL,
-	MARKER_MOVED_BLOCK_END_SYMBOL,
-	MARKER_ARROW_SYMBOL
-};
-
-
-constexpr int MARKER_MASK_CHANGED		=	(1 << MARKER_CHANGED_LINE)	|	(1 << MARKER_CHANGED_SYMBOL);
-constexpr int MARKER_MASK_CHANGED_LOCAL	=	(1 << MARKER_CHANGED_LINE)	|	(1 << MARKER_CHANGED_LOCAL_SYMBOL);
-constexpr int MARKER_MASK_ADDED			=	(1 << MARKER_ADDED_LINE)	|	(1 << MARKER_ADDED_SYMBOL);
-constexpr int MARKER_MASK_ADDED_LOCAL	=	(1 << MARKER_ADDED_LINE)	|	(1 << MARKER_ADDED_LOCAL_SYMBOL);
-constexpr int MARKER_MASK_REMOVED		=	(1 << MARKER_REMOVED_LINE)	|	(1 << MARKER_REMOVED_SYMBOL);
-constexpr int MARKER_MASK_REMOVED_LOCAL	=	(1 << MARKER_REMOVED_LINE)	|	(1 << MARKER_REMOVED_LOCAL_SYMBOL);
-constexpr int MARKER_MASK_MOVED_LINE	=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_LINE_SYMBOL);
-constexpr int MARKER_MASK_MOVED_BEGIN	=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_BLOCK_BEGIN_SYMBOL);
-constexpr int MARKER_MASK_MOVED_MID		=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_BLOCK_MID_SYMBOL);
-constexpr int MARKER_MASK_MOVED_END		=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_BLOCK_END_SYMBOL);
-constexpr int MARKER_MASK_MOVED			=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_LINE_SYMBOL) |
-																			(1 << MARKER_MOVED_BLOCK_BEGIN_SYMBOL) |
-																			(1 << MARKER_MOVED_BLOCK_MID_SYMBOL) |
-																			(1 << MARKER_MOVED_BLOCK_END_SYMBOL);
-
-constexpr int MARKER_MASK_BLANK			=	(1 << MARKER_BLANK);
-constexpr int MARKER_MASK_ARROW			=	(1 << MARKER_ARROW_SYMBOL);
-
-constexpr int MARKER_MASK_LINE			=	(1 << MARKER_CHANGED_LINE) |
-											(1 << MARKER_ADDED_LINE) |
-											(1 << MARKER_REMOVED_LINE) |
-											(1 << MARKER_MOVED_LINE);
-
-constexpr int MARKER_MASK_SYMBOL		=	(1 << MARKER_CHANGED_SYMBOL) |
-											(1 << MARKER_CHANGED_LOCAL_SYMBOL) |
-											(1 << MARKER_ADDED_SYMBOL) |
-											(1 << MARKER_ADDED_LOCAL_SYMBOL) |
-											(1 << MARKER_REMOVED_SYMBOL) |
-											(1 << MARKER_REMOVED_LOCAL_SYMBOL) |
-											(1 << MARKER_MOVED_LINE_SYMBOL) |
-											(1 << MARKER_MOVED_BLOCK_BEGIN_SYMBOL) |
-											(1 << MARKER_MOVED_BLOCK_MID_SYMBOL) |
-											(1 << MARKER_MOVED_BLOCK_END_SYMBOL);
-
-constexpr int MARKER_MASK_ALL			=	MARKER_MASK_LINE | MARKER_MASK_SYMBOL;
-
 constexpr int MARGIN_NUM = 4;
 
 
@@ -653,7 +597,6 @@ inline void clearAnnotation(int view, intptr_t line)
 void clearAnnotations(int view, intptr_t startLine, intptr_t length);
 
 std::vector<char> getText(int view, intptr_t startPos, intptr_t endPos);
-void toLowerCase(std::vector<char>& text);
 
 void addBlankSection(int view, intptr_t line, intptr_t length, intptr_t selectionMarkPosition = 0,
 		const char *text = nullptr);
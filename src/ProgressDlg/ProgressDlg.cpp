@@ -35,8 +35,7 @@ const int ProgressDlg::cBTNheight         = 25;
 
 // Different compare phases progress end positions
 const int ProgressDlg::cPhases[] = {
-	5,		// Docs1 hashes
-	10,		// Docs2 hashes
+	10,		// Docs hashes
 	20,		// Docs diff
 	90,		// Blocks diff
 	100,	// Results colorization and presentation
@@ -40,6 +40,7 @@ const TCHAR UserSettings::followingCaretSetting[]			= TEXT("following_caret");
 const TCHAR UserSettings::detectMovesSetting[]				= TEXT("detect_moves");
 const TCHAR UserSettings::detectCharDiffsSetting[]			= TEXT("detect_character_diffs");
 const TCHAR UserSettings::bestSeqChangedLinesSetting[]		= TEXT("best_seq_changed_lines");
+const TCHAR UserSettings::histogramDiffSetting[]			= TEXT("histogram_diff");
 const TCHAR UserSettings::ignoreSpacesSetting[]				= TEXT("ignore_spaces");
 const TCHAR UserSettings::ignoreEmptyLinesSetting[]			= TEXT("ignore_empty_lines");
 const TCHAR UserSettings::ignoreCaseSetting[]				= TEXT("ignore_case");
@@ -51,6 +52,11 @@ const TCHAR UserSettings::navBarSetting[]					= TEXT("navigation_bar");
 
 const TCHAR UserSettings::reCompareOnChangeSetting[]		= TEXT("recompare_on_change");
 
+const TCHAR UserSettings::workerThreadsSetting[]			= TEXT("worker_threads");
+const TCHAR UserSettings::fastCharDiffsSetting[]			= TEXT("fast_char_diffs");
+const TCHAR UserSettings::discardUnmatchedLinesSetting[]	= TEXT("discard_unmatched_lines");
+const TCHAR UserSettings::minimalLinesDiffSetting[]			= TEXT("minimal_lines_diff");
+
 const TCHAR UserSettings::statusTypeSetting[]				= TEXT("status_type");
 
 const TCHAR UserSettings::colorsSection[]					= TEXT("color_settings");
@@ -108,6 +114,7 @@ void UserSettings::load()
 	DetectMoves			= ::GetPrivateProfileInt(mainSection, detectMovesSetting,			1, iniFile) != 0;
 	DetectCharDiffs		= ::GetPrivateProfileInt(mainSection, detectCharDiffsSetting,		0, iniFile) != 0;
 	BestSeqChangedLines	= ::GetPrivateProfileInt(mainSection, bestSeqChangedLinesSetting,	0, iniFile) != 0;
+	HistogramDiff		= ::GetPrivateProfileInt(mainSection, histogramDiffSetting,			0, iniFile) != 0;
 	IgnoreSpaces		= ::GetPrivateProfileInt(mainSection, ignoreSpacesSetting,			0, iniFile) != 0;
 	IgnoreEmptyLines	= ::GetPrivateProfileInt(mainSection, ignoreEmptyLinesSetting,		0, iniFile) != 0;
 	IgnoreCase			= ::GetPrivateProfileInt(mainSection, ignoreCaseSetting,			0, iniFile) != 0;
@@ -125,6 +132,13 @@ void UserSettings::load()
 
 	RecompareOnChange	= ::GetPrivateProfileInt(mainSection, reCompareOnChangeSetting,	1, iniFile) != 0;
 
+	WorkerThreads		= ::GetPrivateProfileInt(mainSection, workerThreadsSetting,
+			DEFAULT_WORKER_THREADS, iniFile);
+	FastCharDiffs		= ::GetPrivateProfileInt(mainSection, fastCharDiffsSetting,			0, iniFile) != 0;
+	DiscardUnmatchedLines	= ::GetPrivateProfileInt(mainSection, discardUnmatchedLinesSetting,
+			0, iniFile) != 0;
+	MinimalLinesDiff	= ::GetPrivateProfileInt(mainSection, minimalLinesDiffSetting,		0, iniFile) != 0;
+
 	SavedStatusType	= static_cast<StatusType>(::GetPrivateProfileInt(mainSection, statusTypeSetting,
 			DEFAULT_STATUS_TYPE, iniFile));
 
@@ -243,6 +257,8 @@ void UserSettings::save()
 			DetectCharDiffs ? TEXT("1") : TEXT("0"), iniFile);
 	::WritePrivateProfileString(mainSection, bestSeqChangedLinesSetting,
 			BestSeqChangedLines ? TEXT("1") : TEXT("0"), iniFile);
+	::WritePrivateProfileString(mainSection, histogramDiffSetting,
+			HistogramDiff ? TEXT("1") : TEXT("0"), iniFile);
 	::WritePrivateProfileString(mainSection, ignoreSpacesSetting,
 			IgnoreSpaces ? TEXT("1") : TEXT("0"), iniFile);
 	::WritePrivateProfileString(mainSection, ignoreEmptyLinesSetting,
@@ -270,6 +286,15 @@ void UserSettings::save()
 	_itot_s(static_cast<int>(SavedStatusType), buffer, 64, 10);
 	::WritePrivateProfileString(mainSection, statusTypeSetting, buffer, iniFile);
 
+	_itot_s(WorkerThreads, buffer, 64, 10);
+	::WritePrivateProfileString(mainSection, workerThreadsSetting, buffer, iniFile);
+	::WritePrivateProfileString(mainSection, fastCharDiffsSetting,
+			FastCharDiffs ? TEXT("1") : TEXT("0"), iniFile);
+	::WritePrivateProfileString(mainSection, discardUnmatchedLinesSetting,
+			DiscardUnmatchedLines ? TEXT("1") : TEXT("0"), iniFile);
+	::WritePrivateProfileString(mainSection, minimalLinesDiffSetting,
+			MinimalLinesDiff ? TEXT("1") : TEXT("0"), iniFile);
+
 	_itot_s(colorsLight.added, buffer, 64, 10);
 	::WritePrivateProfileString(colorsSection, addedColorSetting, buffer, iniFile);
 
@@ -57,6 +57,9 @@
 
 #define DEFAULT_CHANGED_THRESHOLD		30
 
+// 0 - compare on all hardware threads
+#define DEFAULT_WORKER_THREADS			0
+
 
 enum StatusType
 {
@@ -134,6 +137,7 @@ public:
 	static const TCHAR detectMovesSetting[];
 	static const TCHAR detectCharDiffsSetting[];
 	static const TCHAR bestSeqChangedLinesSetting[];
+	static const TCHAR histogramDiffSetting[];
 	static const TCHAR ignoreSpacesSetting[];
 	static const TCHAR ignoreEmptyLinesSetting[];
 	static const TCHAR ignoreCaseSetting[];
@@ -146,6 +150,11 @@ public:
 
 	static const TCHAR reCompareOnChangeSetting[];
 
+	static const TCHAR workerThreadsSetting[];
+	static const TCHAR fastCharDiffsSetting[];
+	static const TCHAR discardUnmatchedLinesSetting[];
+	static const TCHAR minimalLinesDiffSetting[];
+
 	static const TCHAR statusTypeSetting[];
 
 	static const TCHAR colorsSection[];
@@ -185,6 +194,7 @@ public:
 	bool			DetectMoves;
 	bool			DetectCharDiffs;
 	bool			BestSeqChangedLines;
+	bool			HistogramDiff;
 	bool			IgnoreSpaces;
 	bool			IgnoreEmptyLines;
 	bool			IgnoreCase;
@@ -198,6 +208,11 @@ public:
 	bool			RecompareOnChange;
 	StatusType		statusType;
 
+	int				WorkerThreads;
+	bool			FastCharDiffs;
+	bool			DiscardUnmatchedLines;
+	bool			MinimalLinesDiff;
+
 	int				ChangedThresholdPercent;
 
 private: